@@ -0,0 +1,42 @@
+/*
+ * arch/arm/include/asm/neon.h
+ *
+ * Kernel-mode NEON support.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_NEON_H
+#define __ASM_ARM_NEON_H
+
+/*
+ * Smallest memcpy()/memset() handed to the NEON routines. Below this
+ * the cost of enabling the unit outweighs the bandwidth gain.
+ */
+#define NEON_STRING_MIN		1024
+
+#ifndef __ASSEMBLY__
+
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(!!(elf_hwcap & HWCAP_NEON))
+
+/*
+ * NEON (and VFP) registers may only be used by the kernel between
+ * kernel_neon_begin() and kernel_neon_end():
+ *
+ *  - never from interrupt or softirq context, as the interrupted
+ *    context may have live NEON state;
+ *  - the region runs with preemption disabled, so keep it short and
+ *    do not sleep in it;
+ *  - the object file using NEON instructions must only be entered
+ *    through such a region, as the rest of the kernel is built for
+ *    a soft-float ABI.
+ */
+extern void kernel_neon_begin(void);
+extern void kernel_neon_end(void);
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* __ASM_ARM_NEON_H */
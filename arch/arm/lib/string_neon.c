@@ -0,0 +1,216 @@
+/*
+ *  linux/arch/arm/lib/string_neon.c
+ *
+ *  Large memcpy(), memset() and copy_page() through NEON.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * memcpy() and memset() branch here for sizes of at least
+ * NEON_STRING_MIN bytes.  Once the VFP support code has reported
+ * NEON, those copies are done in chunks with the unit claimed through
+ * kernel_neon_begin(); everything else (atomic context, no NEON,
+ * early boot) goes to the original ARM routines.
+ *
+ * Booting with "string_neon.bench=1" prints the bandwidth of both
+ * implementations for sizes from 64 bytes to 1MB.
+ */
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/hardirq.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#include <asm/neon.h>
+#include <asm/page.h>
+
+extern void *__memcpy_arm(void *, const void *, size_t);
+extern void *__memset_arm(void *, int, size_t);
+extern void __copy_page_arm(void *, const void *);
+
+extern void __memcpy_neon(void *, const void *, size_t);
+extern void __memset_neon(void *, int, size_t);
+extern void __copy_page_neon(void *, const void *);
+
+/*
+ * Bound the time spent with preemption disabled: 32KB is well
+ * below 50us even at the slowest memory clock.
+ */
+#define NEON_CHUNK	(32 * 1024)
+
+static int neon_string_enabled __read_mostly;
+
+static int bench;
+module_param(bench, bool, 0444);
+MODULE_PARM_DESC(bench, "Print NEON vs ARM string bandwidth at boot");
+
+/*
+ * kernel_neon_begin() may only be used where the caller could have been
+ * preempted: not from interrupt context, under a spinlock or with
+ * preemption or interrupts disabled.
+ */
+static inline int neon_string_usable(void)
+{
+	return neon_string_enabled && !in_atomic() && !irqs_disabled();
+}
+
+void *neon_memcpy(void *dest, const void *src, size_t n)
+{
+	char *d = dest;
+	const char *s = src;
+	size_t chunk;
+
+	if (!neon_string_usable())
+		return __memcpy_arm(dest, src, n);
+
+	while (n >= 64) {
+		chunk = min_t(size_t, n, NEON_CHUNK) & ~63;
+
+		kernel_neon_begin();
+		__memcpy_neon(d, s, chunk);
+		kernel_neon_end();
+
+		d += chunk;
+		s += chunk;
+		n -= chunk;
+	}
+
+	if (n)
+		__memcpy_arm(d, s, n);
+
+	return dest;
+}
+
+void *neon_memset(void *dest, int c, size_t n)
+{
+	char *d = dest;
+	size_t chunk;
+
+	if (!neon_string_usable())
+		return __memset_arm(dest, c, n);
+
+	while (n >= 64) {
+		chunk = min_t(size_t, n, NEON_CHUNK) & ~63;
+
+		kernel_neon_begin();
+		__memset_neon(d, c, chunk);
+		kernel_neon_end();
+
+		d += chunk;
+		n -= chunk;
+	}
+
+	if (n)
+		__memset_arm(d, c, n);
+
+	return dest;
+}
+
+void copy_page(void *to, const void *from)
+{
+	if (!neon_string_usable()) {
+		__copy_page_arm(to, from);
+		return;
+	}
+
+	kernel_neon_begin();
+	__copy_page_neon(to, from);
+	kernel_neon_end();
+}
+
+#define BENCH_MAX	(1024 * 1024)
+#define BENCH_BYTES	(4 * 1024 * 1024)
+
+static unsigned long __init bench_mbps(size_t bytes, s64 ns)
+{
+	return ns > 0 ? div64_u64((u64)bytes * 1000, ns) : 0;
+}
+
+static void __init neon_string_bench(void)
+{
+	char *src, *dst;
+	size_t size, done;
+	ktime_t start;
+	s64 arm_ns, neon_ns;
+
+	src = vmalloc(BENCH_MAX);
+	dst = vmalloc(BENCH_MAX);
+	if (!src || !dst)
+		goto out;
+
+	__memset_arm(src, 0x5a, BENCH_MAX);
+	__memset_arm(dst, 0, BENCH_MAX);
+
+	printk(KERN_INFO "NEON string: memcpy bandwidth (MB/s)\n");
+	printk(KERN_INFO "NEON string: %8s %8s %8s\n", "size", "arm", "neon");
+
+	for (size = 64; size <= BENCH_MAX; size <<= 1) {
+		start = ktime_get();
+		for (done = 0; done < BENCH_BYTES; done += size)
+			__memcpy_arm(dst, src, size);
+		arm_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		start = ktime_get();
+		for (done = 0; done < BENCH_BYTES; done += size) {
+			kernel_neon_begin();
+			__memcpy_neon(dst, src, size);
+			kernel_neon_end();
+		}
+		neon_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		printk(KERN_INFO "NEON string: %8zu %8lu %8lu\n", size,
+		       bench_mbps(BENCH_BYTES, arm_ns),
+		       bench_mbps(BENCH_BYTES, neon_ns));
+	}
+
+	start = ktime_get();
+	for (done = 0; done < BENCH_BYTES; done += BENCH_MAX)
+		__memset_arm(dst, 0, BENCH_MAX);
+	arm_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (done = 0; done < BENCH_BYTES; done += BENCH_MAX)
+		neon_memset(dst, 0, BENCH_MAX);
+	neon_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	printk(KERN_INFO "NEON string: memset 1MB arm %lu neon %lu MB/s\n",
+	       bench_mbps(BENCH_BYTES, arm_ns), bench_mbps(BENCH_BYTES, neon_ns));
+
+	start = ktime_get();
+	for (done = 0; done < BENCH_BYTES; done += PAGE_SIZE)
+		__copy_page_arm(dst, src);
+	arm_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (done = 0; done < BENCH_BYTES; done += PAGE_SIZE)
+		copy_page(dst, src);
+	neon_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	printk(KERN_INFO "NEON string: copy_page arm %lu neon %lu MB/s\n",
+	       bench_mbps(BENCH_BYTES, arm_ns), bench_mbps(BENCH_BYTES, neon_ns));
+out:
+	vfree(dst);
+	vfree(src);
+}
+
+/*
+ * Runs after vfp_init(), which is what sets HWCAP_NEON.
+ */
+static int __init neon_string_init(void)
+{
+	if (!cpu_has_neon())
+		return 0;
+
+	neon_string_enabled = 1;
+	printk(KERN_INFO "NEON string: using NEON for copies of %d bytes "
+	       "and more\n", NEON_STRING_MIN);
+
+	if (bench)
+		neon_string_bench();
+
+	return 0;
+}
+late_initcall_sync(neon_string_init);
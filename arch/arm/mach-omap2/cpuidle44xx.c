@@ -98,6 +98,12 @@ static int omap4_enter_idle(struct cpuidle_device *dev,
 	local_irq_disable();
 	local_fiq_disable();
 
+	/*
+	 * Whatever the governor picked, this is only a WFI until CPU1
+	 * is off, so let wakeups know this cpu is quick to wake.
+	 */
+	sched_idle_set_exit_latency(dev->states[OMAP4_STATE_C1].exit_latency);
+
 	/*
 	 * Do only WFI for non-boot CPU(aux cores)
 	 */
@@ -126,6 +132,8 @@ static int omap4_enter_idle(struct cpuidle_device *dev,
 		goto return_sleep_time;
 	}
 
+	sched_idle_set_exit_latency(state->exit_latency);
+
 	if (cx->type > OMAP4_STATE_C1)
 		clockevents_notify(CLOCK_EVT_NOTIFY_BROADCAST_ENTER, &cpu_id);
 
@@ -23,6 +23,7 @@
 #include <linux/io.h>
 #include <linux/clk.h>
 #include <linux/omapfb.h>
+#include <linux/cma.h>
 
 #include <asm/tlb.h>
 
@@ -258,6 +259,7 @@ static void __init _omap2_map_common_io(void)
 	omap_sram_init();
 	omapfb_reserve_sdram();
 	omap_vram_reserve_sdram();
+	cma_reserve_default();
 
 #ifdef CONFIG_TF_MSHIELD
 	tf_allocate_workspace();
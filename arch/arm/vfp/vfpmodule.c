@@ -17,9 +17,11 @@
 #include <linux/sched.h>
 #include <linux/smp.h>
 #include <linux/init.h>
+#include <linux/hardirq.h>
 
 #include <asm/thread_notify.h>
 #include <asm/vfp.h>
+#include <asm/neon.h>
 
 #include "vfpinstr.h"
 #include "vfp.h"
@@ -486,6 +488,47 @@ void vfp_flush_hwstate(struct thread_info *thread)
 	put_cpu();
 }
 
+#ifdef CONFIG_NEON
+/*
+ * Kernel-side NEON support: the caller must not be in interrupt context,
+ * and preemption stays disabled between kernel_neon_begin() and
+ * kernel_neon_end() so the kernel's NEON registers never need saving.
+ */
+void kernel_neon_begin(void)
+{
+	unsigned int cpu;
+	u32 fpexc;
+
+	BUG_ON(in_interrupt());
+	cpu = get_cpu();
+
+	fpexc = fmrx(FPEXC) | FPEXC_EN;
+	fmxr(FPEXC, fpexc);
+
+	/*
+	 * Save the state of whichever thread still owns the hardware
+	 * registers (on UP this need not be current) and force it to
+	 * be reloaded on its next VFP access.
+	 */
+	if (last_VFP_context[cpu]) {
+		vfp_save_state(last_VFP_context[cpu], fpexc);
+#ifdef CONFIG_SMP
+		last_VFP_context[cpu]->hard.cpu = cpu;
+#endif
+		last_VFP_context[cpu] = NULL;
+	}
+}
+EXPORT_SYMBOL(kernel_neon_begin);
+
+void kernel_neon_end(void)
+{
+	/* Disable the unit again so the next user access traps */
+	fmxr(FPEXC, fmrx(FPEXC) & ~FPEXC_EN);
+	put_cpu();
+}
+EXPORT_SYMBOL(kernel_neon_end);
+#endif
+
 #ifdef CONFIG_HOTPLUG_CPU
 static int vfp_hotplug_notifier(struct notifier_block *b, unsigned long action,
 				void *data)
@@ -0,0 +1,459 @@
+/*
+ *  Flash i/o scheduler.
+ *
+ *  A non-idling scheduler for devices without seek penalty (eMMC, SD).
+ *  Requests are kept in fifos per io priority class; synchronous requests
+ *  (reads, O_SYNC/fsync writes) are served ahead of asynchronous writes of
+ *  the same class, and a request that has waited past its deadline is
+ *  served whatever its class.
+ *
+ *  Based on the deadline i/o scheduler.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+#include <linux/ioprio.h>
+#include <linux/iocontext.h>
+
+/*
+ * See Documentation/block/flash-iosched.txt
+ */
+static const int sync_expire = HZ / 2;	/* max time before a sync request is served */
+static const int async_expire = 5 * HZ; /* ditto for async, these limits are SOFT! */
+static const int async_starved = 4;	/* max sync dispatches while async waits */
+
+/*
+ * Service classes, in the order they are served.
+ */
+enum {
+	FLASH_CLASS_RT,
+	FLASH_CLASS_BE,
+	FLASH_CLASS_IDLE,
+	FLASH_NR_CLASSES,
+};
+
+struct flash_data {
+	/*
+	 * run time data
+	 */
+
+	/*
+	 * every request is on sort_list (for front merges) and on the
+	 * sync or async fifo of its class
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[2][FLASH_NR_CLASSES];
+
+	unsigned int nr_queued;
+	unsigned int starved;		/* sync dispatches while async waited */
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int fifo_expire[2];
+	int async_starved;
+	int front_merges;
+};
+
+static void flash_move_to_dispatch(struct flash_data *, struct request *);
+
+/*
+ * the class is stored biased by one, so that requests allocated without
+ * elevator data end up in the best-effort class
+ */
+#define RQ_CLASS(rq)	((rq)->elevator_private ?			\
+			 (int)(unsigned long)(rq)->elevator_private - 1 :	\
+			 FLASH_CLASS_BE)
+
+static inline struct rb_root *
+flash_rb_root(struct flash_data *fd, struct request *rq)
+{
+	return &fd->sort_list[rq_data_dir(rq)];
+}
+
+/*
+ * pick up the io priority class of the submitting task, the same way
+ * cfq does
+ */
+static int flash_task_class(void)
+{
+	struct io_context *ioc = current->io_context;
+	int ioprio_class;
+
+	if (ioc && ioprio_valid(ioc->ioprio))
+		ioprio_class = IOPRIO_PRIO_CLASS(ioc->ioprio);
+	else
+		ioprio_class = task_nice_ioclass(current);
+
+	switch (ioprio_class) {
+	case IOPRIO_CLASS_RT:
+		return FLASH_CLASS_RT;
+	case IOPRIO_CLASS_IDLE:
+		return FLASH_CLASS_IDLE;
+	default:
+		return FLASH_CLASS_BE;
+	}
+}
+
+static void
+flash_add_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	struct rb_root *root = flash_rb_root(fd, rq);
+	struct request *__alias;
+
+	while (unlikely(__alias = elv_rb_add(root, rq)))
+		flash_move_to_dispatch(fd, __alias);
+}
+
+/*
+ * add rq to rbtree and to the fifo of its kind and class
+ */
+static void
+flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int sync = rq_is_sync(rq);
+
+	flash_add_rq_rb(fd, rq);
+
+	/*
+	 * set expire time and add to fifo list
+	 */
+	rq_set_fifo_time(rq, jiffies + fd->fifo_expire[sync]);
+	list_add_tail(&rq->queuelist, &fd->fifo_list[sync][RQ_CLASS(rq)]);
+	fd->nr_queued++;
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void flash_remove_request(struct flash_data *fd, struct request *rq)
+{
+	rq_fifo_clear(rq);
+	elv_rb_del(flash_rb_root(fd, rq), rq);
+	fd->nr_queued--;
+}
+
+static int
+flash_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *__rq;
+
+	/*
+	 * check for front merge
+	 */
+	if (fd->front_merges) {
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		__rq = elv_rb_find(&fd->sort_list[bio_data_dir(bio)], sector);
+		if (__rq) {
+			BUG_ON(sector != blk_rq_pos(__rq));
+
+			if (elv_rq_merge_ok(__rq, bio)) {
+				*req = __rq;
+				return ELEVATOR_FRONT_MERGE;
+			}
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void flash_merged_request(struct request_queue *q,
+				 struct request *req, int type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(flash_rb_root(fd, req), req);
+		flash_add_rq_rb(fd, req);
+	}
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *req,
+		      struct request *next)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if next expires before req and both sit on the same fifo, move
+	 * req into next's position (next will be deleted)
+	 */
+	if (RQ_CLASS(req) == RQ_CLASS(next) &&
+	    rq_is_sync(req) == rq_is_sync(next) &&
+	    !list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	flash_remove_request(fd, next);
+}
+
+/*
+ * move request from sort list to dispatch queue.
+ */
+static void
+flash_move_to_dispatch(struct flash_data *fd, struct request *rq)
+{
+	flash_remove_request(fd, rq);
+	elv_dispatch_add_tail(rq->q, rq);
+}
+
+static inline int flash_first_class(struct list_head *lists)
+{
+	int class;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++)
+		if (!list_empty(&lists[class]))
+			break;
+
+	return class;
+}
+
+/*
+ * the request that expired first, if any.  Only fifo heads need to be
+ * looked at, as every fifo is in expiry order.
+ */
+static struct request *flash_expired_request(struct flash_data *fd)
+{
+	struct request *rq, *oldest = NULL;
+	int sync, class;
+
+	for (sync = 0; sync < 2; sync++) {
+		for (class = 0; class < FLASH_NR_CLASSES; class++) {
+			struct list_head *fifo = &fd->fifo_list[sync][class];
+
+			if (list_empty(fifo))
+				continue;
+			rq = rq_entry_fifo(fifo->next);
+			if (!oldest ||
+			    time_before(rq_fifo_time(rq), rq_fifo_time(oldest)))
+				oldest = rq;
+		}
+	}
+
+	if (oldest && time_after_eq(jiffies, rq_fifo_time(oldest)))
+		return oldest;
+	return NULL;
+}
+
+/*
+ * flash_dispatch_requests never idles: if anything is queued, something
+ * is dispatched.  An expired request goes first, so that lower classes
+ * and async writes cannot be starved.  Otherwise a higher class goes
+ * first; within a class sync requests win until async ones have been
+ * passed over async_starved times.
+ */
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	int sync_class, async_class;
+	struct request *rq;
+
+	if (!fd->nr_queued)
+		return 0;
+
+	rq = flash_expired_request(fd);
+	if (rq) {
+		if (!rq_is_sync(rq))
+			fd->starved = 0;
+		goto dispatch_request;
+	}
+
+	sync_class = flash_first_class(fd->fifo_list[1]);
+	async_class = flash_first_class(fd->fifo_list[0]);
+
+	if (sync_class < async_class ||
+	    (sync_class == async_class && fd->starved < fd->async_starved)) {
+		rq = rq_entry_fifo(fd->fifo_list[1][sync_class].next);
+		if (async_class == sync_class)
+			fd->starved++;
+		goto dispatch_request;
+	}
+
+	fd->starved = 0;
+	rq = rq_entry_fifo(fd->fifo_list[0][async_class].next);
+
+dispatch_request:
+	flash_move_to_dispatch(fd, rq);
+
+	return 1;
+}
+
+static int flash_queue_empty(struct request_queue *q)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	return !fd->nr_queued;
+}
+
+static int
+flash_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
+{
+	rq->elevator_private = (void *)(unsigned long)(flash_task_class() + 1);
+	return 0;
+}
+
+static void flash_put_request(struct request *rq)
+{
+	rq->elevator_private = NULL;
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	BUG_ON(fd->nr_queued);
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static void *flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+	int i;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	fd->sort_list[READ] = RB_ROOT;
+	fd->sort_list[WRITE] = RB_ROOT;
+	for (i = 0; i < FLASH_NR_CLASSES; i++) {
+		INIT_LIST_HEAD(&fd->fifo_list[0][i]);
+		INIT_LIST_HEAD(&fd->fifo_list[1][i]);
+	}
+
+	fd->fifo_expire[1] = sync_expire;
+	fd->fifo_expire[0] = async_expire;
+	fd->async_starved = async_starved;
+	fd->front_merges = 1;
+	return fd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_sync_expire_show, fd->fifo_expire[1], 1);
+SHOW_FUNCTION(flash_async_expire_show, fd->fifo_expire[0], 1);
+SHOW_FUNCTION(flash_async_starved_show, fd->async_starved, 0);
+SHOW_FUNCTION(flash_front_merges_show, fd->front_merges, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_sync_expire_store, &fd->fifo_expire[1], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_async_expire_store, &fd->fifo_expire[0], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_async_starved_store, &fd->async_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_front_merges_store, &fd->front_merges, 0, 1, 0);
+#undef STORE_FUNCTION
+
+#define FD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FD_ATTR(sync_expire),
+	FD_ATTR(async_expire),
+	FD_ATTR(async_starved),
+	FD_ATTR(front_merges),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_fn = 		flash_merge,
+		.elevator_merged_fn =		flash_merged_request,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_queue_empty_fn =	flash_queue_empty,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_set_req_fn =		flash_set_request,
+		.elevator_put_req_fn =		flash_put_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("flash IO scheduler");
@@ -436,6 +436,7 @@ static void dpm_show_time(ktime_t starttime, pm_message_t state, char *info)
  */
 static int device_resume_noirq(struct device *dev, pm_message_t state)
 {
+	ktime_t start = dpm_timeline_now();
 	int error = 0;
 
 	TRACE_DEVICE(dev);
@@ -461,6 +462,7 @@ static int device_resume_noirq(struct device *dev, pm_message_t state)
 	}
 
 End:
+	dpm_timeline_add(dev, DPM_RESUME_NOIRQ, start, start, false, error);
 	TRACE_RESUME(error);
 	return error;
 }
@@ -522,6 +524,7 @@ static int legacy_resume(struct device *dev, int (*cb)(struct device *dev))
  */
 static int device_resume(struct device *dev, pm_message_t state, bool async)
 {
+	ktime_t queued = dpm_timeline_now(), start;
 	int error = 0;
 
 	TRACE_DEVICE(dev);
@@ -531,6 +534,7 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 			    dev->parent->power.status == DPM_RESUMING))
 		dpm_wait(dev->parent, async);
 	device_lock(dev);
+	start = dpm_timeline_now();
 
 	dev->power.status = DPM_RESUMING;
 
@@ -565,6 +569,7 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 		}
 	}
  End:
+	dpm_timeline_add(dev, DPM_RESUME, queued, start, async, error);
 	device_unlock(dev);
 	complete_all(&dev->power.completion);
 
@@ -690,7 +695,10 @@ static void dpm_resume(pm_message_t state)
  */
 static void device_complete(struct device *dev, pm_message_t state)
 {
+	ktime_t queued = dpm_timeline_now(), start;
+
 	device_lock(dev);
+	start = dpm_timeline_now();
 
 	if (dev->class && dev->class->pm && dev->class->pm->complete) {
 		pm_dev_dbg(dev, state, "completing class ");
@@ -707,6 +715,7 @@ static void device_complete(struct device *dev, pm_message_t state)
 		dev->bus->pm->complete(dev);
 	}
 
+	dpm_timeline_add(dev, DPM_COMPLETE, queued, start, false, 0);
 	device_unlock(dev);
 }
 
@@ -794,6 +803,7 @@ static pm_message_t resume_event(pm_message_t sleep_state)
  */
 static int device_suspend_noirq(struct device *dev, pm_message_t state)
 {
+	ktime_t start = dpm_timeline_now();
 	int error = 0;
 
 	if (dev->class && dev->class->pm) {
@@ -816,6 +826,7 @@ static int device_suspend_noirq(struct device *dev, pm_message_t state)
 	}
 
 End:
+	dpm_timeline_add(dev, DPM_SUSPEND_NOIRQ, start, start, false, error);
 	return error;
 }
 
@@ -883,10 +894,12 @@ static int async_error;
  */
 static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 {
+	ktime_t queued = dpm_timeline_now(), start;
 	int error = 0;
 
 	dpm_wait_for_children(dev, async);
 	device_lock(dev);
+	start = dpm_timeline_now();
 
 	if (async_error)
 		goto End;
@@ -926,6 +939,7 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 		dev->power.status = DPM_OFF;
 
  End:
+	dpm_timeline_add(dev, DPM_SUSPEND, queued, start, async, error);
 	device_unlock(dev);
 	complete_all(&dev->power.completion);
 
@@ -1015,9 +1029,11 @@ static int dpm_suspend(pm_message_t state)
  */
 static int device_prepare(struct device *dev, pm_message_t state)
 {
+	ktime_t queued = dpm_timeline_now(), start;
 	int error = 0;
 
 	device_lock(dev);
+	start = dpm_timeline_now();
 
 	if (dev->bus && dev->bus->pm && dev->bus->pm->prepare) {
 		pm_dev_dbg(dev, state, "preparing ");
@@ -1041,6 +1057,7 @@ static int device_prepare(struct device *dev, pm_message_t state)
 		suspend_report_result(dev->class->pm->prepare, error);
 	}
  End:
+	dpm_timeline_add(dev, DPM_PREPARE, queued, start, false, error);
 	device_unlock(dev);
 
 	return error;
@@ -1112,6 +1129,7 @@ int dpm_suspend_start(pm_message_t state)
 	int error;
 
 	might_sleep();
+	dpm_timeline_begin();
 	error = dpm_prepare(state);
 	if (!error)
 		error = dpm_suspend(state);
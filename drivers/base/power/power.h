@@ -30,6 +30,42 @@ extern void device_pm_move_before(struct device *, struct device *);
 extern void device_pm_move_after(struct device *, struct device *);
 extern void device_pm_move_last(struct device *);
 
+enum dpm_phase {
+	DPM_PREPARE,
+	DPM_SUSPEND,
+	DPM_SUSPEND_NOIRQ,
+	DPM_RESUME_NOIRQ,
+	DPM_RESUME,
+	DPM_COMPLETE,
+};
+
+#ifdef CONFIG_PM_TIMELINE
+
+/* drivers/base/power/timeline.c */
+extern void dpm_timeline_begin(void);
+extern void dpm_timeline_add(struct device *dev, enum dpm_phase phase,
+			     ktime_t queued, ktime_t start, bool async,
+			     int error);
+
+static inline ktime_t dpm_timeline_now(void)
+{
+	return ktime_get();
+}
+
+#else /* !CONFIG_PM_TIMELINE */
+
+static inline void dpm_timeline_begin(void) {}
+static inline void dpm_timeline_add(struct device *dev, enum dpm_phase phase,
+				    ktime_t queued, ktime_t start, bool async,
+				    int error) {}
+
+static inline ktime_t dpm_timeline_now(void)
+{
+	return ktime_set(0, 0);
+}
+
+#endif /* !CONFIG_PM_TIMELINE */
+
 #else /* !CONFIG_PM_SLEEP */
 
 static inline void device_pm_init(struct device *dev)
@@ -0,0 +1,230 @@
+/*
+ * drivers/base/power/timeline.c - Timeline of device suspend and resume.
+ *
+ * This file is released under the GPLv2.
+ *
+ * Every device handled by the PM core during a system sleep transition
+ * leaves one record per phase in a ring buffer: when its callbacks were
+ * started, relative to the beginning of the transition, how long they
+ * ran, and how long the device had been waiting for its parent (resume)
+ * or its children (suspend) before that.  Together with the pid of the
+ * thread the callbacks ran in, this shows which devices were handled
+ * asynchronously and what they were held up by.
+ *
+ * The records are dumped sorted by start time in <debugfs>/pm_timeline.
+ * Writing to that file empties the buffer.
+ */
+
+#include <linux/device.h>
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+
+#include "power.h"
+
+#define DPM_TL_SIZE		(1 << CONFIG_PM_TIMELINE_SHIFT)
+#define DPM_TL_NAME_LEN		24
+
+struct dpm_tl_entry {
+	u32	cycle;
+	u32	start;		/* us since the transition began */
+	u32	wait;		/* us spent waiting for parent or children */
+	u32	duration;	/* us spent in the callbacks */
+	pid_t	pid;
+	int	error;
+	u8	phase;
+	u8	async;
+	char	name[DPM_TL_NAME_LEN];
+	char	parent[DPM_TL_NAME_LEN];
+};
+
+struct dpm_tl_snapshot {
+	unsigned int		nr;
+	struct dpm_tl_entry	entry[0];
+};
+
+static struct dpm_tl_entry dpm_tl[DPM_TL_SIZE];
+static unsigned int dpm_tl_head;	/* records ever added */
+static u32 dpm_tl_cycle;
+static ktime_t dpm_tl_cycle_start;
+static DEFINE_SPINLOCK(dpm_tl_lock);
+
+static const char *const dpm_tl_phases[] = {
+	[DPM_PREPARE]		= "prepare",
+	[DPM_SUSPEND]		= "suspend",
+	[DPM_SUSPEND_NOIRQ]	= "suspend_noirq",
+	[DPM_RESUME_NOIRQ]	= "resume_noirq",
+	[DPM_RESUME]		= "resume",
+	[DPM_COMPLETE]		= "complete",
+};
+
+static u32 dpm_tl_us(ktime_t from, ktime_t to)
+{
+	return clamp_t(s64, ktime_us_delta(to, from), 0, (u32)~0U);
+}
+
+/**
+ * dpm_timeline_begin - Start a new system sleep transition.
+ */
+void dpm_timeline_begin(void)
+{
+	spin_lock_irq(&dpm_tl_lock);
+	dpm_tl_cycle++;
+	dpm_tl_cycle_start = ktime_get();
+	spin_unlock_irq(&dpm_tl_lock);
+}
+
+/**
+ * dpm_timeline_add - Record one phase of a device's transition.
+ * @dev: Device handled.
+ * @phase: Phase of the transition.
+ * @queued: When the PM core got to @dev.
+ * @start: When the callbacks of @dev were started.
+ * @async: If true, @dev was handled asynchronously.
+ * @error: Result of the callbacks.
+ *
+ * The phase is taken to have ended at the time of the call.
+ */
+void dpm_timeline_add(struct device *dev, enum dpm_phase phase,
+		      ktime_t queued, ktime_t start, bool async, int error)
+{
+	ktime_t end = ktime_get();
+	struct dpm_tl_entry *e;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dpm_tl_lock, flags);
+	e = &dpm_tl[dpm_tl_head++ & (DPM_TL_SIZE - 1)];
+	e->cycle = dpm_tl_cycle;
+	e->start = dpm_tl_us(dpm_tl_cycle_start, start);
+	e->wait = dpm_tl_us(queued, start);
+	e->duration = dpm_tl_us(start, end);
+	e->pid = current->pid;
+	e->error = error;
+	e->phase = phase;
+	e->async = async;
+	strlcpy(e->name, dev_name(dev), sizeof(e->name));
+	strlcpy(e->parent, dev->parent ? dev_name(dev->parent) : "",
+		sizeof(e->parent));
+	spin_unlock_irqrestore(&dpm_tl_lock, flags);
+}
+
+static int dpm_tl_cmp(const void *a, const void *b)
+{
+	const struct dpm_tl_entry *x = a, *y = b;
+
+	if (x->cycle != y->cycle)
+		return x->cycle < y->cycle ? -1 : 1;
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	return 0;
+}
+
+static void *dpm_tl_seq_start(struct seq_file *m, loff_t *pos)
+{
+	struct dpm_tl_snapshot *s = m->private;
+
+	if (!*pos)
+		return SEQ_START_TOKEN;
+	return *pos <= s->nr ? &s->entry[*pos - 1] : NULL;
+}
+
+static void *dpm_tl_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	return dpm_tl_seq_start(m, pos);
+}
+
+static void dpm_tl_seq_stop(struct seq_file *m, void *v)
+{
+}
+
+static int dpm_tl_seq_show(struct seq_file *m, void *v)
+{
+	struct dpm_tl_entry *e = v;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(m, "cycle phase           start_us  wait_us   dur_us "
+			 "A    pid error device (parent)\n");
+		return 0;
+	}
+
+	seq_printf(m, "%5u %-13s %10u %8u %8u %c %6d %5d %s",
+		   e->cycle, dpm_tl_phases[e->phase], e->start, e->wait,
+		   e->duration, e->async ? 'A' : '-', e->pid, e->error,
+		   e->name);
+	if (e->parent[0])
+		seq_printf(m, " (%s)", e->parent);
+	seq_putc(m, '\n');
+	return 0;
+}
+
+static const struct seq_operations dpm_tl_seq_ops = {
+	.start	= dpm_tl_seq_start,
+	.next	= dpm_tl_seq_next,
+	.stop	= dpm_tl_seq_stop,
+	.show	= dpm_tl_seq_show,
+};
+
+static int dpm_tl_open(struct inode *inode, struct file *file)
+{
+	struct dpm_tl_snapshot *s;
+	unsigned int head, i;
+	int error;
+
+	s = vmalloc(sizeof(*s) + sizeof(dpm_tl));
+	if (!s)
+		return -ENOMEM;
+
+	spin_lock_irq(&dpm_tl_lock);
+	head = dpm_tl_head;
+	s->nr = min_t(unsigned int, head, DPM_TL_SIZE);
+	for (i = 0; i < s->nr; i++)
+		s->entry[i] = dpm_tl[(head - s->nr + i) & (DPM_TL_SIZE - 1)];
+	spin_unlock_irq(&dpm_tl_lock);
+
+	sort(s->entry, s->nr, sizeof(s->entry[0]), dpm_tl_cmp, NULL);
+
+	error = seq_open(file, &dpm_tl_seq_ops);
+	if (error) {
+		vfree(s);
+		return error;
+	}
+	((struct seq_file *)file->private_data)->private = s;
+	return 0;
+}
+
+static int dpm_tl_release(struct inode *inode, struct file *file)
+{
+	vfree(((struct seq_file *)file->private_data)->private);
+	return seq_release(inode, file);
+}
+
+static ssize_t dpm_tl_write(struct file *file, const char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	spin_lock_irq(&dpm_tl_lock);
+	dpm_tl_head = 0;
+	spin_unlock_irq(&dpm_tl_lock);
+	return count;
+}
+
+static const struct file_operations dpm_tl_fops = {
+	.open		= dpm_tl_open,
+	.read		= seq_read,
+	.write		= dpm_tl_write,
+	.llseek		= seq_lseek,
+	.release	= dpm_tl_release,
+};
+
+static int __init dpm_timeline_init(void)
+{
+	debugfs_create_file("pm_timeline", S_IRUGO | S_IWUSR, NULL, NULL,
+			    &dpm_tl_fops);
+	return 0;
+}
+late_initcall(dpm_timeline_init);
@@ -84,8 +84,10 @@ static void cpuidle_idle_call(void)
 	target_state = &dev->states[next_state];
 
 	/* enter the state and update stats */
+	sched_idle_set_exit_latency(target_state->exit_latency);
 	dev->last_state = target_state;
 	dev->last_residency = target_state->enter(dev, target_state);
+	sched_idle_set_exit_latency(0);
 	if (dev->last_state)
 		target_state = dev->last_state;
 
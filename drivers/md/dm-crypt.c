@@ -18,6 +18,7 @@
 #include <linux/crypto.h>
 #include <linux/workqueue.h>
 #include <linux/backing-dev.h>
+#include <linux/padata.h>
 #include <asm/atomic.h>
 #include <linux/scatterlist.h>
 #include <asm/page.h>
@@ -41,6 +42,7 @@ struct convert_context {
 	unsigned int idx_out;
 	sector_t sector;
 	atomic_t pending;
+	struct ablkcipher_request *req;
 };
 
 /*
@@ -57,6 +59,15 @@ struct dm_crypt_io {
 	int error;
 	sector_t sector;
 	struct dm_crypt_io *base_io;
+
+#ifdef CONFIG_DM_CRYPT_PARALLEL
+	/*
+	 * Writes converted on the parallel path complete in the order
+	 * they were mapped; padata.pd is only set for ios handed to
+	 * padata.
+	 */
+	struct padata_priv padata;
+#endif
 };
 
 struct dm_crypt_request {
@@ -90,7 +101,7 @@ struct iv_benbi_private {
  * Crypt: maps a linear range of a block device
  * and encrypts / decrypts at the same time.
  */
-enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID };
+enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID, DM_CRYPT_PARALLEL };
 struct crypt_config {
 	struct dm_dev *dev;
 	sector_t start;
@@ -133,7 +144,12 @@ struct crypt_config {
 	 * correctly aligned.
 	 */
 	unsigned int dmreq_start;
-	struct ablkcipher_request *req;
+
+#ifdef CONFIG_DM_CRYPT_PARALLEL
+	/* next cpu for read decryption, cpu for write serialization */
+	atomic_t read_cpu;
+	int cb_cpu;
+#endif
 
 	char cipher[CRYPTO_MAX_ALG_NAME];
 	char chainmode[CRYPTO_MAX_ALG_NAME];
@@ -149,6 +165,21 @@ struct crypt_config {
 
 static struct kmem_cache *_crypt_io_pool;
 
+#ifdef CONFIG_DM_CRYPT_PARALLEL
+/*
+ * Parallel conversion: writes are spread over all active cpus through
+ * padata, which hands them back in submission order so that the
+ * original bios complete in that order; reads are simply distributed
+ * round-robin since their completion order does not matter.
+ */
+static int parallel = 1;
+module_param(parallel, bool, S_IRUGO);
+MODULE_PARM_DESC(parallel, "Spread encryption over all cpus (sync ciphers)");
+
+static struct padata_instance *_crypt_padata;
+static struct workqueue_struct *_crypt_padata_wq;
+#endif
+
 static void clone_init(struct dm_crypt_io *, struct bio *);
 static void kcryptd_queue_crypt(struct dm_crypt_io *io);
 
@@ -460,13 +491,13 @@ static void kcryptd_async_done(struct crypto_async_request *async_req,
 static void crypt_alloc_req(struct crypt_config *cc,
 			    struct convert_context *ctx)
 {
-	if (!cc->req)
-		cc->req = mempool_alloc(cc->req_pool, GFP_NOIO);
-	ablkcipher_request_set_tfm(cc->req, cc->tfm);
-	ablkcipher_request_set_callback(cc->req, CRYPTO_TFM_REQ_MAY_BACKLOG |
+	if (!ctx->req)
+		ctx->req = mempool_alloc(cc->req_pool, GFP_NOIO);
+	ablkcipher_request_set_tfm(ctx->req, cc->tfm);
+	ablkcipher_request_set_callback(ctx->req, CRYPTO_TFM_REQ_MAY_BACKLOG |
 					CRYPTO_TFM_REQ_MAY_SLEEP,
 					kcryptd_async_done,
-					dmreq_of_req(cc, cc->req));
+					dmreq_of_req(cc, ctx->req));
 }
 
 /*
@@ -475,7 +506,7 @@ static void crypt_alloc_req(struct crypt_config *cc,
 static int crypt_convert(struct crypt_config *cc,
 			 struct convert_context *ctx)
 {
-	int r;
+	int r = 0;
 
 	atomic_set(&ctx->pending, 1);
 
@@ -486,7 +517,7 @@ static int crypt_convert(struct crypt_config *cc,
 
 		atomic_inc(&ctx->pending);
 
-		r = crypt_convert_block(cc, ctx, cc->req);
+		r = crypt_convert_block(cc, ctx, ctx->req);
 
 		switch (r) {
 		/* async */
@@ -495,7 +526,7 @@ static int crypt_convert(struct crypt_config *cc,
 			INIT_COMPLETION(ctx->restart);
 			/* fall through*/
 		case -EINPROGRESS:
-			cc->req = NULL;
+			ctx->req = NULL;
 			ctx->sector++;
 			continue;
 
@@ -509,11 +540,22 @@ static int crypt_convert(struct crypt_config *cc,
 		/* error */
 		default:
 			atomic_dec(&ctx->pending);
-			return r;
+			goto out;
 		}
 	}
 
-	return 0;
+out:
+	/*
+	 * Give back the request cached for synchronous conversion right
+	 * away: ios waiting in padata for this one to be serialized may
+	 * not return theirs for a while.
+	 */
+	if (ctx->req) {
+		mempool_free(ctx->req, cc->req_pool);
+		ctx->req = NULL;
+	}
+
+	return r;
 }
 
 static void dm_crypt_bio_destructor(struct bio *bio)
@@ -605,7 +647,11 @@ static struct dm_crypt_io *crypt_io_alloc(struct dm_target *ti,
 	io->sector = sector;
 	io->error = 0;
 	io->base_io = NULL;
+	io->ctx.req = NULL;
 	atomic_set(&io->pending, 0);
+#ifdef CONFIG_DM_CRYPT_PARALLEL
+	io->padata.pd = NULL;
+#endif
 
 	return io;
 }
@@ -862,6 +908,21 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 		}
 	}
 
+#ifdef CONFIG_DM_CRYPT_PARALLEL
+	/*
+	 * The clones have been submitted already, so nothing taken from
+	 * page_pool or the bioset waits on the ordering; only the
+	 * reference taken above is dropped in order, by the serial
+	 * callback.
+	 */
+	if (io->padata.pd) {
+		local_bh_disable();
+		padata_do_serial(&io->padata);
+		local_bh_enable();
+		return;
+	}
+#endif
+
 	crypt_dec_pending(io);
 }
 
@@ -925,10 +986,92 @@ static void kcryptd_crypt(struct work_struct *work)
 		kcryptd_crypt_write_convert(io);
 }
 
+#ifdef CONFIG_DM_CRYPT_PARALLEL
+/*
+ * Called by padata in submission order, with BHs off.  The base bio
+ * completes once its clones have, at the earliest.
+ */
+static void kcryptd_crypt_serial(struct padata_priv *padata)
+{
+	struct dm_crypt_io *io = container_of(padata, struct dm_crypt_io,
+					      padata);
+
+	crypt_dec_pending(io);
+}
+
+/*
+ * Called by padata on the cpu chosen for this io, with BHs off.
+ * Conversion may sleep, so hand it to this cpu's kcryptd thread.
+ */
+static void kcryptd_crypt_parallel(struct padata_priv *padata)
+{
+	struct dm_crypt_io *io = container_of(padata, struct dm_crypt_io,
+					      padata);
+	struct crypt_config *cc = io->target->private;
+
+	INIT_WORK(&io->work, kcryptd_crypt);
+	queue_work_on(smp_processor_id(), cc->crypt_queue, &io->work);
+}
+
+static unsigned int kcryptd_active_cpu(unsigned int cpu)
+{
+	unsigned int cpu_index, i;
+
+	if (cpumask_test_cpu(cpu, cpu_active_mask))
+		return cpu;
+
+	cpu_index = cpu % cpumask_weight(cpu_active_mask);
+
+	cpu = cpumask_first(cpu_active_mask);
+	for (i = 0; i < cpu_index; i++)
+		cpu = cpumask_next(cpu, cpu_active_mask);
+
+	return cpu;
+}
+
+static int kcryptd_queue_crypt_parallel(struct dm_crypt_io *io)
+{
+	struct crypt_config *cc = io->target->private;
+	unsigned int cpu;
+
+	/*
+	 * Reads are queued from bio completion, possibly in interrupt
+	 * context, where padata cannot be entered.
+	 */
+	if (bio_data_dir(io->base_bio) == READ) {
+		cpu = (unsigned int)atomic_inc_return(&cc->read_cpu) %
+		      nr_cpu_ids;
+		cpu = kcryptd_active_cpu(cpu);
+		INIT_WORK(&io->work, kcryptd_crypt);
+		queue_work_on(cpu, cc->crypt_queue, &io->work);
+		return 0;
+	}
+
+	io->padata.parallel = kcryptd_crypt_parallel;
+	io->padata.serial = kcryptd_crypt_serial;
+
+	cc->cb_cpu = kcryptd_active_cpu(cc->cb_cpu);
+	if (padata_do_parallel(_crypt_padata, &io->padata,
+			       cc->cb_cpu) == -EINPROGRESS)
+		return 0;
+
+	return -EBUSY;
+}
+#endif
+
 static void kcryptd_queue_crypt(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->target->private;
 
+#ifdef CONFIG_DM_CRYPT_PARALLEL
+	if (test_bit(DM_CRYPT_PARALLEL, &cc->flags)) {
+		if (!kcryptd_queue_crypt_parallel(io))
+			return;
+
+		/* padata is saturated, convert and submit out of order */
+	}
+#endif
+
 	INIT_WORK(&io->work, kcryptd_crypt);
 	queue_work(cc->crypt_queue, &io->work);
 }
@@ -1134,7 +1277,6 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		ti->error = "Cannot allocate crypt request mempool";
 		goto bad_req_pool;
 	}
-	cc->req = NULL;
 
 	cc->page_pool = mempool_create_page_pool(MIN_POOL_PAGES, 0);
 	if (!cc->page_pool) {
@@ -1177,13 +1319,31 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	} else
 		cc->iv_mode = NULL;
 
-	cc->io_queue = create_singlethread_workqueue("kcryptd_io");
+	cc->io_queue = create_singlethread_reclaim_workqueue("kcryptd_io");
 	if (!cc->io_queue) {
 		ti->error = "Couldn't create kcryptd io queue";
 		goto bad_io_queue;
 	}
 
-	cc->crypt_queue = create_singlethread_workqueue("kcryptd");
+#ifdef CONFIG_DM_CRYPT_PARALLEL
+	/*
+	 * Asynchronous (hardware) ciphers gain nothing from being fed
+	 * by several cpus, so only spread synchronous ones.
+	 */
+	if (parallel && _crypt_padata && num_online_cpus() > 1 &&
+	    !(crypto_ablkcipher_tfm(tfm)->__crt_alg->cra_flags &
+	      CRYPTO_ALG_ASYNC)) {
+		set_bit(DM_CRYPT_PARALLEL, &cc->flags);
+		atomic_set(&cc->read_cpu, 0);
+		cc->cb_cpu = cpumask_first(cpu_active_mask);
+	}
+
+	if (test_bit(DM_CRYPT_PARALLEL, &cc->flags))
+		cc->crypt_queue = create_reclaim_workqueue("kcryptd");
+	else
+#endif
+		cc->crypt_queue =
+			create_singlethread_reclaim_workqueue("kcryptd");
 	if (!cc->crypt_queue) {
 		ti->error = "Couldn't create kcryptd queue";
 		goto bad_crypt_queue;
@@ -1225,9 +1385,6 @@ static void crypt_dtr(struct dm_target *ti)
 	destroy_workqueue(cc->io_queue);
 	destroy_workqueue(cc->crypt_queue);
 
-	if (cc->req)
-		mempool_free(cc->req, cc->req_pool);
-
 	bioset_free(cc->bs);
 	mempool_destroy(cc->page_pool);
 	mempool_destroy(cc->req_pool);
@@ -1407,6 +1564,36 @@ static struct target_type crypt_target = {
 	.iterate_devices = crypt_iterate_devices,
 };
 
+#ifdef CONFIG_DM_CRYPT_PARALLEL
+static void crypt_padata_init(void)
+{
+	/* Failing here only means falling back to per-device kcryptd */
+	_crypt_padata_wq = create_reclaim_workqueue("kcryptd_padata");
+	if (!_crypt_padata_wq)
+		return;
+
+	_crypt_padata = padata_alloc(cpu_possible_mask, _crypt_padata_wq);
+	if (!_crypt_padata) {
+		destroy_workqueue(_crypt_padata_wq);
+		return;
+	}
+
+	padata_start(_crypt_padata);
+}
+
+static void crypt_padata_exit(void)
+{
+	if (!_crypt_padata)
+		return;
+
+	padata_free(_crypt_padata);
+	destroy_workqueue(_crypt_padata_wq);
+}
+#else
+static inline void crypt_padata_init(void) { }
+static inline void crypt_padata_exit(void) { }
+#endif
+
 static int __init dm_crypt_init(void)
 {
 	int r;
@@ -1415,9 +1602,12 @@ static int __init dm_crypt_init(void)
 	if (!_crypt_io_pool)
 		return -ENOMEM;
 
+	crypt_padata_init();
+
 	r = dm_register_target(&crypt_target);
 	if (r < 0) {
 		DMERR("register failed %d", r);
+		crypt_padata_exit();
 		kmem_cache_destroy(_crypt_io_pool);
 	}
 
@@ -1427,6 +1617,7 @@ static int __init dm_crypt_init(void)
 static void __exit dm_crypt_exit(void)
 {
 	dm_unregister_target(&crypt_target);
+	crypt_padata_exit();
 	kmem_cache_destroy(_crypt_io_pool);
 }
 
@@ -75,6 +75,7 @@ struct neighbour_stats {
 
 struct slot {
 	u8 busy;		/* is slot occupied */
+	u16 free_run;		/* free slots from here to the right in row */
 	struct tcm_area parent; /* parent area */
 	u32 reserved;
 };
@@ -91,6 +91,8 @@ static s32 get_busy_neigh_stats(struct tcm *tcm, u16 width, u16 height,
 			struct tcm_area *top_left_corner,
 			struct neighbour_stats *neighbour_stat);
 
+static void update_free_runs(struct sita_pvt *pvt, u16 x0, u16 x1, u16 y);
+
 static void fill_1d_area(struct tcm *tcm,
 			struct tcm_area *area, struct slot slot);
 
@@ -637,6 +639,7 @@ static s32 scan_l2r_t2b(struct tcm *tcm, u16 w, u16 h, u16 stride,
 		 struct tcm_area *field, struct tcm_area *area)
 {
 	s32 xx = 0, yy = 0;
+	u16 run;
 	s16 start_x = -1, end_x = -1, start_y = -1, end_y = -1;
 	s16 found_x = -1, found_y = -1;
 	LIST_HEAD(maybes);
@@ -694,6 +697,10 @@ static s32 scan_l2r_t2b(struct tcm *tcm, u16 w, u16 h, u16 stride,
 #endif
 					break;
 				}
+				/* no fit until this row's free run ends */
+				run = pvt->map[xx][yy].free_run;
+				if (run < w)
+					xx = ALIGN(xx + run, stride) - stride;
 			} else {
 				/* Optimization required only for Non Aligned,
 				Aligned anyways skip by 32/64 tiles at a time */
@@ -740,6 +747,7 @@ static s32 scan_l2r_b2t(struct tcm *tcm, u16 w, u16 h, u16 stride,
 			struct tcm_area *field, struct tcm_area *area)
 {
 	s32 xx = 0, yy = 0;
+	u16 run;
 	s16 start_x = -1, end_x = -1, start_y = -1, end_y = -1;
 	s16 found_x = -1, found_y = -1;
 	LIST_HEAD(maybes);
@@ -797,6 +805,10 @@ static s32 scan_l2r_b2t(struct tcm *tcm, u16 w, u16 h, u16 stride,
 #endif
 					break;
 				}
+				/* no fit until this row's free run ends */
+				run = pvt->map[xx][yy].free_run;
+				if (run < w)
+					xx = ALIGN(xx + run, stride) - stride;
 			} else {
 				/* Optimization required only for Non Aligned,
 				Aligned anyways skip by 32/64 tiles at a time */
@@ -1014,14 +1026,13 @@ static s32 scan_areas_and_find_fit(struct tcm *tcm, u16 w, u16 h, u16 stride,
 static s32 check_fit_r_and_b(struct tcm *tcm, u16 w, u16 h, u16 left_x,
 			     u16 top_y)
 {
-	u16 xx = 0, yy = 0;
+	u16 yy = 0;
 	struct sita_pvt *pvt = (struct sita_pvt *)tcm->pvt;
 
+	/* the area fits if every row has w free slots starting at left_x */
 	for (yy = top_y; yy < top_y + h; yy++) {
-		for (xx = left_x; xx < left_x + w; xx++) {
-			if (pvt->map[xx][yy].busy)
-				return false;
-		}
+		if (pvt->map[left_x][yy].free_run < w)
+			return false;
 	}
 	return true;
 }
@@ -1079,6 +1090,9 @@ static void fill_2d_area(struct tcm *tcm, struct tcm_area *area,
 	for (x = area->p0.x; x <= area->p1.x; ++x)
 		for (y = area->p0.y; y <= area->p1.y; ++y)
 			pvt->map[x][y] = slot;
+
+	for (y = area->p0.y; y <= area->p1.y; ++y)
+		update_free_runs(pvt, area->p0.x, area->p1.x, y);
 }
 
 /* area should be a valid area */
@@ -1101,6 +1115,36 @@ static void fill_1d_area(struct tcm *tcm, struct tcm_area *area,
 	}
 	/* set the last slot */
 	pvt->map[x][y] = slot;
+
+	for (y = area->p0.y; y <= area->p1.y; y++)
+		update_free_runs(pvt, y == area->p0.y ? area->p0.x : 0,
+				 y == area->p1.y ? area->p1.x : pvt->width - 1,
+				 y);
+}
+
+/*
+ * Recompute the free run lengths of row y after slots x0..x1 changed.
+ * Runs only change to the left of the last changed slot, and only up to
+ * the first busy slot left of x0.
+ */
+static void update_free_runs(struct sita_pvt *pvt, u16 x0, u16 x1, u16 y)
+{
+	s32 x;
+	u16 run = 0;
+
+	if (x1 + 1 < pvt->width)
+		run = pvt->map[x1 + 1][y].free_run;
+
+	for (x = x1; x >= 0; x--) {
+		if (pvt->map[x][y].busy) {
+			pvt->map[x][y].free_run = 0;
+			if (x < x0)
+				break;
+			run = 0;
+		} else {
+			pvt->map[x][y].free_run = ++run;
+		}
+	}
 }
 
 static void select_candidate(struct tcm *tcm, u16 w, u16 h,
@@ -28,7 +28,7 @@
 #include <asm/cacheflush.h>
 
 #define PMEM_MAX_DEVICES 10
-#define PMEM_MAX_ORDER 128
+#define PMEM_MAX_ORDER (sizeof(unsigned long) * 8)
 #define PMEM_MIN_ALLOC PAGE_SIZE
 
 #define PMEM_DEBUG 1
@@ -82,6 +82,8 @@ struct pmem_data {
 struct pmem_bits {
 	unsigned allocated:1;		/* 1 if allocated, 0 if free */
 	unsigned order:7;		/* size of the region in pmem space */
+	/* links free slots of the same order, see pmem_info.free_list */
+	struct list_head free;
 };
 
 struct pmem_region_node {
@@ -116,6 +118,14 @@ struct pmem_info {
 	/* the bitmap for the region indicating which entries are allocated
 	 * and which are free */
 	struct pmem_bits *bitmap;
+	/* the free slots of the bitmap, one list per order, so that
+	 * allocation and free never have to walk the bitmap */
+	struct list_head free_list[PMEM_MAX_ORDER];
+	unsigned long nr_free[PMEM_MAX_ORDER];
+	/* allocator statistics, reported in debugfs */
+	unsigned long free_entries;
+	unsigned long nr_allocs;
+	unsigned long nr_alloc_fails;
 	/* indicates the region should not be managed with an allocator */
 	unsigned no_allocator;
 	/* indicates maps of this region should be cached, if a mix of
@@ -131,7 +141,8 @@ struct pmem_info {
 	 * needed */
 	struct semaphore data_list_sem;
 	struct list_head data_list;
-	/* pmem_sem protects the bitmap array
+	/* pmem_sem protects the bitmap array, the free lists and the
+	 * allocator statistics
 	 * a write lock should be held when modifying entries in bitmap
 	 * a read lock should be held when reading data from bits or
 	 * dereferencing a pointer into bitmap
@@ -166,6 +177,7 @@ static int id_count;
 	PMEM_LEN(id, index))
 #define PMEM_REVOKED(data) (data->flags & PMEM_FLAGS_REVOKED)
 #define PMEM_IS_PAGE_ALIGNED(addr) (!((addr) & (~PAGE_MASK)))
+#define PMEM_INDEX(id, bits) ((bits) - pmem[id].bitmap)
 #define PMEM_IS_SUBMAP(data) ((data->flags & PMEM_FLAGS_SUBMAP) && \
 	(!(data->flags & PMEM_FLAGS_UNSUBMAP)))
 
@@ -232,6 +244,25 @@ static int is_master_owner(struct file *file)
 	return ret;
 }
 
+static void pmem_add_free(int id, int index)
+{
+	int order = PMEM_ORDER(id, index);
+
+	pmem[id].bitmap[index].allocated = 0;
+	list_add(&pmem[id].bitmap[index].free, &pmem[id].free_list[order]);
+	pmem[id].nr_free[order]++;
+	pmem[id].free_entries += 1UL << order;
+}
+
+static void pmem_del_free(int id, int index)
+{
+	int order = PMEM_ORDER(id, index);
+
+	list_del_init(&pmem[id].bitmap[index].free);
+	pmem[id].nr_free[order]--;
+	pmem[id].free_entries -= 1UL << order;
+}
+
 static int pmem_free(int id, int index)
 {
 	/* caller should hold the write lock on pmem_sem! */
@@ -247,18 +278,21 @@ static int pmem_free(int id, int index)
 	/* find a slots buddy Buddy# = Slot# ^ (1 << order)
 	 * if the buddy is also free merge them
 	 * repeat until the buddy is not free or end of the bitmap is reached
+	 * a buddy inside the bitmap is always the first slot of a region, so
+	 * only its own entry has to be looked at
 	 */
-	do {
+	for (;;) {
 		buddy = PMEM_BUDDY_INDEX(id, curr);
-		if (PMEM_IS_FREE(id, buddy) &&
-				PMEM_ORDER(id, buddy) == PMEM_ORDER(id, curr)) {
-			PMEM_ORDER(id, buddy)++;
-			PMEM_ORDER(id, curr)++;
-			curr = min(buddy, curr);
-		} else {
+		if (buddy >= pmem[id].num_entries ||
+		    !PMEM_IS_FREE(id, buddy) ||
+		    PMEM_ORDER(id, buddy) != PMEM_ORDER(id, curr))
 			break;
-		}
-	} while (curr < pmem[id].num_entries);
+		pmem_del_free(id, buddy);
+		PMEM_ORDER(id, buddy)++;
+		PMEM_ORDER(id, curr)++;
+		curr = min(buddy, curr);
+	}
+	pmem_add_free(id, curr);
 
 	return 0;
 }
@@ -380,10 +414,9 @@ static int pmem_allocate(int id, unsigned long len)
 {
 	/* caller should hold the write lock on pmem_sem! */
 	/* return the corresponding pdata[] entry */
-	int curr = 0;
-	int end = pmem[id].num_entries;
 	int best_fit = -1;
 	unsigned long order = pmem_order(len);
+	unsigned long curr;
 
 	if (pmem[id].no_allocator) {
 		DLOG("no allocator");
@@ -393,36 +426,30 @@ static int pmem_allocate(int id, unsigned long len)
 		return len;
 	}
 
-	if (order > PMEM_MAX_ORDER)
-		return -1;
+	pmem[id].nr_allocs++;
 	DLOG("order %lx\n", order);
 
-	/* look through the bitmap:
-	 * 	if you find a free slot of the correct order use it
-	 * 	otherwise, use the best fit (smallest with size > order) slot
+	/* take a free slot of the correct order if there is one,
+	 * otherwise the best fit (smallest with size > order) slot
 	 */
-	while (curr < end) {
-		if (PMEM_IS_FREE(id, curr)) {
-			if (PMEM_ORDER(id, curr) == (unsigned char)order) {
-				/* set the not free bit and clear others */
-				best_fit = curr;
-				break;
-			}
-			if (PMEM_ORDER(id, curr) > (unsigned char)order &&
-			    (best_fit < 0 ||
-			     PMEM_ORDER(id, curr) < PMEM_ORDER(id, best_fit)))
-				best_fit = curr;
+	for (curr = order; curr < PMEM_MAX_ORDER; curr++) {
+		if (!list_empty(&pmem[id].free_list[curr])) {
+			best_fit = PMEM_INDEX(id,
+				list_first_entry(&pmem[id].free_list[curr],
+						 struct pmem_bits, free));
+			break;
 		}
-		curr = PMEM_NEXT_INDEX(id, curr);
 	}
 
 	/* if best_fit < 0, there are no suitable slots,
 	 * return an error
 	 */
 	if (best_fit < 0) {
+		pmem[id].nr_alloc_fails++;
 		printk("pmem: no space left to allocate!\n");
 		return -1;
 	}
+	pmem_del_free(id, best_fit);
 
 	/* now partition the best fit:
 	 * 	split the slot into 2 buddies of order - 1
@@ -433,6 +460,7 @@ static int pmem_allocate(int id, unsigned long len)
 		PMEM_ORDER(id, best_fit) -= 1;
 		buddy = PMEM_BUDDY_INDEX(id, best_fit);
 		PMEM_ORDER(id, buddy) = PMEM_ORDER(id, best_fit);
+		pmem_add_free(id, buddy);
 	}
 	pmem[id].bitmap[best_fit].allocated = 1;
 	return best_fit;
@@ -1171,6 +1199,36 @@ static ssize_t debug_open(struct inode *inode, struct file *file)
 	return 0;
 }
 
+/* free slots per order, plus how much of the free space is outside the
+ * largest free slot, i.e. unusable for an allocation of that size */
+static int debug_alloc_stats(int id, char *buffer, int size)
+{
+	unsigned long largest = 0;
+	int i, n = 0;
+
+	down_read(&pmem[id].bitmap_sem);
+	for (i = 0; i < PMEM_MAX_ORDER; i++)
+		if (pmem[id].nr_free[i])
+			largest = 1UL << i;
+
+	n += scnprintf(buffer + n, size - n,
+		       "free %lu of %lu pages, largest free %lu pages, "
+		       "fragmentation %lu%%\n", pmem[id].free_entries,
+		       pmem[id].num_entries, largest,
+		       pmem[id].free_entries ? 100 - largest * 100 /
+					pmem[id].free_entries : 0);
+	n += scnprintf(buffer + n, size - n, "free slots by order:");
+	for (i = 0; i < PMEM_MAX_ORDER; i++)
+		if (pmem[id].nr_free[i])
+			n += scnprintf(buffer + n, size - n, " %d:%lu", i,
+				       pmem[id].nr_free[i]);
+	n += scnprintf(buffer + n, size - n, "\nallocations %lu failed %lu\n",
+		       pmem[id].nr_allocs, pmem[id].nr_alloc_fails);
+	up_read(&pmem[id].bitmap_sem);
+
+	return n;
+}
+
 static ssize_t debug_read(struct file *file, char __user *buf, size_t count,
 			  loff_t *ppos)
 {
@@ -1205,6 +1263,9 @@ static ssize_t debug_read(struct file *file, char __user *buf, size_t count,
 	}
 	up(&pmem[id].data_list_sem);
 
+	if (!pmem[id].no_allocator)
+		n += debug_alloc_stats(id, buffer + n, debug_bufmax - n);
+
 	n++;
 	buffer[n] = 0;
 	return simple_read_from_buffer(buf, count, ppos, buffer, n);
@@ -1262,9 +1323,13 @@ int pmem_setup(struct android_pmem_platform_data *pdata,
 	memset(pmem[id].bitmap, 0, sizeof(struct pmem_bits) *
 					  pmem[id].num_entries);
 
+	for (i = 0; i < PMEM_MAX_ORDER; i++)
+		INIT_LIST_HEAD(&pmem[id].free_list[i]);
+
 	for (i = sizeof(pmem[id].num_entries) * 8 - 1; i >= 0; i--) {
 		if ((pmem[id].num_entries) &  1<<i) {
 			PMEM_ORDER(id, index) = i;
+			pmem_add_free(id, index);
 			index = PMEM_NEXT_INDEX(id, index);
 		}
 	}
@@ -2020,6 +2020,7 @@ int mpu3050_probe(struct i2c_client *client,
 	mpu->early_suspend.level = EARLY_SUSPEND_LEVEL_DISABLE_FB + 1;
 	mpu->early_suspend.suspend = mpu3050_early_suspend;
 	mpu->early_suspend.resume = mpu3050_early_resume;
+	mpu->early_suspend.async = true;
 	register_early_suspend(&mpu->early_suspend);
 #endif
 	return res;
@@ -615,6 +615,8 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	unsigned long user_page_addr;
 	struct vm_struct tmp_area;
 	struct page **page;
+	struct page **pages;
+	unsigned long nr_pages;
 	struct mm_struct *mm;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
@@ -624,6 +626,9 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	if (end <= start)
 		return 0;
 
+	pages = &proc->pages[(start - proc->buffer) / PAGE_SIZE];
+	nr_pages = (end - start) / PAGE_SIZE;
+
 	if (vma)
 		mm = NULL;
 	else
@@ -643,18 +648,20 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		goto err_no_vma;
 	}
 
+	for (page = pages; page < pages + nr_pages; page++)
+		BUG_ON(*page);
+	if (alloc_pages_bulk(GFP_KERNEL | __GFP_ZERO, 0, nr_pages,
+			     pages) != nr_pages) {
+		printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
+		       "for pages at %p-%p\n", proc->pid, start, end);
+		goto err_alloc_pages_failed;
+	}
+
 	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
 		int ret;
 		struct page **page_array_ptr;
 		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
 
-		BUG_ON(*page);
-		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
-		if (*page == NULL) {
-			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
-			       "for page at %p\n", proc->pid, page_addr);
-			goto err_alloc_page_failed;
-		}
 		tmp_area.addr = page_addr;
 		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
 		page_array_ptr = page;
@@ -685,18 +692,18 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 free_range:
 	for (page_addr = end - PAGE_SIZE; page_addr >= start;
 	     page_addr -= PAGE_SIZE) {
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
 		if (vma)
 			zap_page_range(vma, (uintptr_t)page_addr +
 				proc->user_buffer_offset, PAGE_SIZE, NULL);
 err_vm_insert_page_failed:
 		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
 err_map_kernel_failed:
-		__free_page(*page);
-		*page = NULL;
-err_alloc_page_failed:
 		;
 	}
+err_alloc_pages_failed:
+	/* pages that were never allocated are still NULL and are skipped */
+	free_pages_bulk(nr_pages, pages, 0);
+	memset(pages, 0, nr_pages * sizeof(*pages));
 err_no_vma:
 	if (mm) {
 		up_write(&mm->mmap_sem);
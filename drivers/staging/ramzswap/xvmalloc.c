@@ -273,20 +273,38 @@ static void remove_block(struct xv_pool *pool, struct page *page, u32 offset,
 }
 
 /*
- * Allocate a page and add it to freelist of given pool.
+ * Take a spare page, refilling them from the page allocator in one go
+ * if needed, and add it to freelist of given pool.
  */
 static int grow_pool(struct xv_pool *pool, gfp_t flags)
 {
-	struct page *page;
+	struct page *page, *pages[XV_SPARE_PAGES];
 	struct block_header *block;
+	unsigned long nr = 0;
 
-	page = alloc_page(flags);
-	if (unlikely(!page))
-		return -ENOMEM;
+	spin_lock(&pool->lock);
+	if (!pool->nr_spare) {
+		spin_unlock(&pool->lock);
+
+		/* Only reclaim for the one page needed right now */
+		nr = alloc_pages_bulk((flags & ~__GFP_WAIT) | __GFP_NOWARN, 0,
+				      XV_SPARE_PAGES, pages);
+		if (!nr) {
+			pages[0] = alloc_page(flags);
+			if (unlikely(!pages[0]))
+				return -ENOMEM;
+			nr = 1;
+		}
+
+		/* Whatever does not fit was raced with another refill */
+		spin_lock(&pool->lock);
+		while (nr && pool->nr_spare < XV_SPARE_PAGES)
+			pool->spare[pool->nr_spare++] = pages[--nr];
+	}
+	page = pool->spare[--pool->nr_spare];
 
 	stat_inc(&pool->total_pages);
 
-	spin_lock(&pool->lock);
 	block = get_ptr_atomic(page, 0, KM_USER0);
 
 	block->size = PAGE_SIZE - XV_ALIGN;
@@ -299,6 +317,8 @@ static int grow_pool(struct xv_pool *pool, gfp_t flags)
 	put_ptr_atomic(block, KM_USER0);
 	spin_unlock(&pool->lock);
 
+	free_pages_bulk(nr, pages, 0);
+
 	return 0;
 }
 
@@ -323,6 +343,7 @@ struct xv_pool *xv_create_pool(void)
 
 void xv_destroy_pool(struct xv_pool *pool)
 {
+	free_pages_bulk(pool->nr_spare, pool->spare, 0);
 	kfree(pool);
 }
 
@@ -466,12 +487,17 @@ void xv_free(struct xv_pool *pool, struct page *page, u32 offset)
 		block = tmpblock;
 	}
 
-	/* No used objects in this page. Free it. */
+	/* No used objects in this page. Keep it spare or free it. */
 	if (block->size == PAGE_SIZE - XV_ALIGN) {
 		put_ptr_atomic(page_start, KM_USER0);
+		if (pool->nr_spare < XV_SPARE_PAGES) {
+			pool->spare[pool->nr_spare++] = page;
+			page = NULL;
+		}
 		spin_unlock(&pool->lock);
 
-		__free_page(page);
+		if (page)
+			__free_page(page);
 		stat_dec(&pool->total_pages);
 		return;
 	}
@@ -36,6 +36,9 @@
 
 #define MAX_FLI		DIV_ROUND_UP(NUM_FREE_LISTS, BITS_PER_LONG)
 
+/* Empty pages kept aside for grow_pool(), allocated in one go */
+#define XV_SPARE_PAGES	16
+
 /* End of user params */
 
 enum blockflags {
@@ -79,6 +82,9 @@ struct xv_pool {
 
 	struct freelist_entry freelist[NUM_FREE_LISTS];
 
+	struct page *spare[XV_SPARE_PAGES];
+	u32 nr_spare;
+
 	/* stats */
 	u64 total_pages;
 };
@@ -112,6 +112,22 @@
 	printk(KERN_INFO "usb %s:%d "fmt, __func__, __LINE__, ##args)
 #endif
 
+/*
+ * Multi-packet transfers: the host may concatenate up to ul_max_pkt_per_xfer
+ * packets into one OUT transfer, and up to dl_max_pkt_per_xfer packets go
+ * into one IN transfer, as far as the MaxTransferSize the host announces
+ * allows.  Setting either to 1 turns it off for that direction.
+ */
+static unsigned int ul_max_pkt_per_xfer = 3;
+module_param(ul_max_pkt_per_xfer, uint, S_IRUGO);
+MODULE_PARM_DESC(ul_max_pkt_per_xfer,
+	"max packets per USB OUT transfer from the host");
+
+static unsigned int dl_max_pkt_per_xfer = 10;
+module_param(dl_max_pkt_per_xfer, uint, S_IRUGO);
+MODULE_PARM_DESC(dl_max_pkt_per_xfer,
+	"max packets per USB IN transfer to the host");
+
 struct rndis_ep_descs {
 	struct usb_endpoint_descriptor	*in;
 	struct usb_endpoint_descriptor	*out;
@@ -457,6 +473,7 @@ static void rndis_command_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	struct f_rndis			*rndis = req->context;
 	struct usb_composite_dev	*cdev = rndis->port.func.config->cdev;
+	rndis_init_msg_type		*init;
 	int				status;
 
 	/* received RNDIS command from USB_CDC_SEND_ENCAPSULATED_COMMAND */
@@ -475,6 +492,16 @@ static void rndis_command_complete(struct usb_ep *ep, struct usb_request *req)
 		ERROR(cdev, "RNDIS command error %d, %d/%d\n",
 			status, req->actual, req->length);
 
+	/* the host tells how large IN transfers it takes */
+	init = req->buf;
+	if (req->actual >= sizeof *init && init->MessageType
+			== cpu_to_le32(REMOTE_NDIS_INITIALIZE_MSG)) {
+		rndis->port.dl_max_xfer_size =
+			le32_to_cpu(init->MaxTransferSize);
+		DBG(cdev, "host MaxTransferSize %u\n",
+			rndis->port.dl_max_xfer_size);
+	}
+
 	CSY_DBG("rndis_command_complete req->length=0x%x\n", req->length);
 //	spin_unlock(&dev->lock);
 }
@@ -817,6 +844,10 @@ rndis_bind(struct usb_configuration *c, struct usb_function *f)
 	rndis_set_param_medium(rndis->config, NDIS_MEDIUM_802_3, 0);
 	rndis_set_host_mac(rndis->config, rndis->ethaddr);
 
+	rndis->port.ul_max_pkts_per_xfer = max(ul_max_pkt_per_xfer, 1U);
+	rndis->port.dl_max_pkts_per_xfer = max(dl_max_pkt_per_xfer, 1U);
+	rndis_set_max_pkt_xfer(rndis->config, rndis->port.ul_max_pkts_per_xfer);
+
 #ifdef CONFIG_USB_ANDROID_RNDIS
 	if (rndis_pdata) {
 		if (rndis_set_param_vendor(rndis->config, rndis_pdata->vendorID,
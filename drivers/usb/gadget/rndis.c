@@ -585,13 +585,15 @@ static int rndis_init_response (int configNr, rndis_init_msg_type *buf)
 	resp->MinorVersion = cpu_to_le32 (RNDIS_MINOR_VERSION);
 	resp->DeviceFlags = cpu_to_le32 (RNDIS_DF_CONNECTIONLESS);
 	resp->Medium = cpu_to_le32 (RNDIS_MEDIUM_802_3);
-	resp->MaxPacketsPerTransfer = cpu_to_le32 (1);
-	resp->MaxTransferSize = cpu_to_le32 (
+	resp->MaxPacketsPerTransfer = cpu_to_le32(params->max_pkt_per_xfer);
+	resp->MaxTransferSize = cpu_to_le32(params->max_pkt_per_xfer * (
 		  params->dev->mtu
 		+ sizeof (struct ethhdr)
 		+ sizeof (struct rndis_packet_msg_type)
-		+ 22);
-	resp->PacketAlignmentFactor = cpu_to_le32 (0);
+		+ 22));
+	/* keep the IP headers of concatenated packets 4-byte aligned */
+	resp->PacketAlignmentFactor =
+		cpu_to_le32(params->max_pkt_per_xfer > 1 ? 2 : 0);
 	resp->AFListOffset = cpu_to_le32 (0);
 	resp->AFListSize = cpu_to_le32 (0);
 
@@ -904,6 +906,7 @@ int rndis_register(void (*resp_avail)(void *v), void *v)
 			rndis_per_dev_params [i].used = 1;
 			rndis_per_dev_params [i].resp_avail = resp_avail;
 			rndis_per_dev_params [i].v = v;
+			rndis_per_dev_params [i].max_pkt_per_xfer = 1;
 			pr_debug("%s: configNr = %d\n", __func__, i);
 			return i;
 		}
@@ -959,6 +962,24 @@ int rndis_set_param_medium (u8 configNr, u32 medium, u32 speed)
 	return 0;
 }
 
+/**
+ * rndis_set_max_pkt_xfer - set how many packets the host may concatenate
+ * @configNr: RNDIS configuration
+ * @max_pkt_per_xfer: packets per OUT transfer, advertised to the host
+ *
+ * Must be called before the host sends REMOTE_NDIS_INITIALIZE_MSG, and
+ * the OUT requests must be sized for that many packets.
+ */
+void rndis_set_max_pkt_xfer(u8 configNr, u32 max_pkt_per_xfer)
+{
+	pr_debug("%s: %u\n", __func__, max_pkt_per_xfer);
+	if (configNr >= RNDIS_MAX_CONFIGS)
+		return;
+
+	rndis_per_dev_params[configNr].max_pkt_per_xfer =
+		max_t(u32, max_pkt_per_xfer, 1);
+}
+
 void rndis_add_hdr (struct sk_buff *skb)
 {
 	struct rndis_packet_msg_type	*header;
@@ -1027,30 +1048,63 @@ static rndis_resp_t *rndis_add_response (int configNr, u32 length)
 	return r;
 }
 
+/*
+ * Hosts may concatenate up to max_pkt_per_xfer packet messages in one
+ * OUT transfer.  Every packet but the last gets a clone of the transfer's
+ * skb, trimmed to its payload; anything after the last message that does
+ * not look like one is padding.
+ */
 int rndis_rm_hdr(struct gether *port,
 			struct sk_buff *skb,
 			struct sk_buff_head *list)
 {
-	/* tmp points to a struct rndis_packet_msg_type */
-	__le32		*tmp = (void *) skb->data;
+	struct rndis_packet_msg_type	*hdr;
+	struct sk_buff			*skb2;
+	u32				msg_len, data_offset, data_len;
+	bool				first = true;
+
+	for (;;) {
+		hdr = (void *) skb->data;
+
+		/* MessageType, MessageLength */
+		if (skb->len < sizeof *hdr
+				|| cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
+					!= get_unaligned(&hdr->MessageType)) {
+			dev_kfree_skb_any(skb);
+			return first ? -EINVAL : 0;
+		}
+		msg_len = get_unaligned_le32(&hdr->MessageLength);
+
+		/* DataOffset, DataLength */
+		data_offset = get_unaligned_le32(&hdr->DataOffset) + 8;
+		data_len = get_unaligned_le32(&hdr->DataLength);
+		if (data_offset > skb->len
+				|| data_len > skb->len - data_offset) {
+			dev_kfree_skb_any(skb);
+			return -EOVERFLOW;
+		}
+		first = false;
+
+		/* the last message keeps the skb itself */
+		if (msg_len < data_offset + data_len
+				|| msg_len + sizeof *hdr > skb->len) {
+			skb_pull(skb, data_offset);
+			skb_trim(skb, data_len);
+			skb_queue_tail(list, skb);
+			return 0;
+		}
 
-	/* MessageType, MessageLength */
-	if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
-			!= get_unaligned(tmp++)) {
-		dev_kfree_skb_any(skb);
-		return -EINVAL;
-	}
-	tmp++;
+		skb2 = skb_clone(skb, GFP_ATOMIC);
+		if (!skb2) {
+			dev_kfree_skb_any(skb);
+			return -ENOMEM;
+		}
+		skb_pull(skb2, data_offset);
+		skb_trim(skb2, data_len);
+		skb_queue_tail(list, skb2);
 
-	/* DataOffset, DataLength */
-	if (!skb_pull(skb, get_unaligned_le32(tmp++) + 8)) {
-		dev_kfree_skb_any(skb);
-		return -EOVERFLOW;
+		skb_pull(skb, msg_len);
 	}
-	skb_trim(skb, get_unaligned_le32(tmp++));
-
-	skb_queue_tail(list, skb);
-	return 0;
 }
 
 #ifdef	CONFIG_USB_GADGET_DEBUG_FILES
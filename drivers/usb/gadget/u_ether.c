@@ -24,6 +24,7 @@
 
 #include <linux/kernel.h>
 #include <linux/gfp.h>
+#include <linux/slab.h>
 #include <linux/device.h>
 #include <linux/ctype.h>
 #include <linux/etherdevice.h>
@@ -69,7 +70,14 @@ struct eth_dev {
 	struct list_head	tx_reqs, rx_reqs;
 	atomic_t		tx_qlen;
 
+	/* multi-packet IN request being filled while others are queued,
+	 * also guarded by req_lock
+	 */
+	struct usb_request	*tx_held;
+	unsigned		tx_held_pkts;
+
 	struct sk_buff_head	rx_frames;
+	struct napi_struct	napi;
 
 	unsigned		header_len;
 	struct sk_buff		*(*wrap)(struct gether *, struct sk_buff *skb);
@@ -92,10 +100,18 @@ struct eth_dev {
 
 #define DEFAULT_QLEN	2	/* double buffering by default */
 
+/*
+ * Buffer of a multi-packet IN request.  One byte is kept free for the
+ * padding that replaces a ZLP on controllers that can't send those.
+ */
+#define TX_MULTI_BUF_LEN	8192
+
+#define ETH_NAPI_WEIGHT	64
+
 
 #ifdef CONFIG_USB_GADGET_DUALSPEED
 
-static unsigned qmult = 5;
+static unsigned qmult = 10;
 module_param(qmult, uint, S_IRUGO|S_IWUSR);
 MODULE_PARM_DESC(qmult, "queue length multiplier at high speed");
 
@@ -201,6 +217,16 @@ static void defer_kevent(struct eth_dev *dev, int flag)
 		DBG(dev, "kevent %d scheduled\n", flag);
 }
 
+/*
+ * A multi-packet IN request owns a kmalloc()ed buffer the packets are
+ * copied into, and points its context there; a single-packet request
+ * sends straight from the skb in its context.
+ */
+static inline bool tx_req_is_multi(struct usb_request *req)
+{
+	return req->buf && req->context == req->buf;
+}
+
 static void rx_complete(struct usb_ep *ep, struct usb_request *req);
 
 static int
@@ -211,11 +237,14 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	size_t		size = 0;
 	struct usb_ep	*out;
 	unsigned long	flags;
+	u32		header_len = 0, pkts = 1;
 
 	spin_lock_irqsave(&dev->lock, flags);
-	if (dev->port_usb)
+	if (dev->port_usb) {
 		out = dev->port_usb->out_ep;
-	else
+		header_len = dev->port_usb->header_len;
+		pkts = max(dev->port_usb->ul_max_pkts_per_xfer, 1U);
+	} else
 		out = NULL;
 	spin_unlock_irqrestore(&dev->lock, flags);
 
@@ -233,10 +262,12 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	 * RNDIS uses internal framing, and explicitly allows senders to
 	 * pad to end-of-packet.  That's potentially nice for speed, but
 	 * means receivers can't recover lost synch on their own (because
-	 * new packets don't only start after a short RX).
+	 * new packets don't only start after a short RX).  It may also
+	 * concatenate several packets in one transfer.
 	 */
 	size += sizeof(struct ethhdr) + dev->net->mtu + RX_EXTRA;
-	size += dev->port_usb->header_len;
+	size += header_len;
+	size *= pkts;
 	size += out->maxpacket - 1;
 	size -= size % out->maxpacket;
 
@@ -277,9 +308,48 @@ enomem:
 	return retval;
 }
 
+/*
+ * Hand the frames rx_complete() queued to the network stack.  Running
+ * from NAPI lets GRO merge the segments of a TCP stream before they go
+ * up the stack.
+ */
+static int eth_poll(struct napi_struct *napi, int budget)
+{
+	struct eth_dev	*dev = container_of(napi, struct eth_dev, napi);
+	struct sk_buff	*skb;
+	int		work = 0;
+
+	while (work < budget && (skb = skb_dequeue(&dev->rx_frames))) {
+		work++;
+		if (ETH_HLEN > skb->len || skb->len > ETH_FRAME_LEN) {
+			dev->net->stats.rx_errors++;
+			dev->net->stats.rx_length_errors++;
+			DBG(dev, "rx length %d\n", skb->len);
+			dev_kfree_skb_any(skb);
+			continue;
+		}
+		skb->protocol = eth_type_trans(skb, dev->net);
+		dev->net->stats.rx_packets++;
+		dev->net->stats.rx_bytes += skb->len;
+
+		/* no buffer copies needed, unless hardware can't
+		 * use skb buffers.
+		 */
+		napi_gro_receive(napi, skb);
+	}
+
+	if (work < budget) {
+		napi_complete(napi);
+		/* rx_complete() may have queued more before we completed */
+		if (!skb_queue_empty(&dev->rx_frames))
+			napi_schedule(napi);
+	}
+	return work;
+}
+
 static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 {
-	struct sk_buff	*skb = req->context, *skb2;
+	struct sk_buff	*skb = req->context;
 	struct eth_dev	*dev = ep->driver_data;
 	int		status = req->status;
 
@@ -313,28 +383,12 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 		}
 		skb = NULL;
 
-		skb2 = skb_dequeue(&dev->rx_frames);
-		while (skb2) {
-			if (status < 0
-					|| ETH_HLEN > skb2->len
-					|| skb2->len > ETH_FRAME_LEN) {
-				dev->net->stats.rx_errors++;
-				dev->net->stats.rx_length_errors++;
-				DBG(dev, "rx length %d\n", skb2->len);
-				dev_kfree_skb_any(skb2);
-				goto next_frame;
-			}
-			skb2->protocol = eth_type_trans(skb2, dev->net);
-			dev->net->stats.rx_packets++;
-			dev->net->stats.rx_bytes += skb2->len;
-
-			/* no buffer copies needed, unless hardware can't
-			 * use skb buffers.
-			 */
-			status = netif_rx(skb2);
-next_frame:
-			skb2 = skb_dequeue(&dev->rx_frames);
+		/* frames unwrapped before a bad one are still good */
+		if (status < 0) {
+			dev->net->stats.rx_errors++;
+			DBG(dev, "rx unwrap %d\n", status);
 		}
+		napi_schedule(&dev->napi);
 		break;
 
 	/* software-driven interface shutdown */
@@ -404,6 +458,8 @@ extra:
 
 		next = req->list.next;
 		list_del(&req->list);
+		if (tx_req_is_multi(req))
+			kfree(req->buf);
 		usb_ep_free_request(ep, req);
 
 		if (next == list)
@@ -469,34 +525,164 @@ static void eth_work(struct work_struct *work)
 		DBG(dev, "work done, flags = 0x%lx\n", dev->todo);
 }
 
+static void tx_queue_held(struct eth_dev *dev, struct usb_ep *in,
+		struct usb_request *req)
+{
+	unsigned long	flags;
+
+	/* use zlp framing on tx, as eth_start_xmit() does */
+	req->zero = 1;
+	if (!dev->zlp && (req->length % in->maxpacket) == 0)
+		req->length++;
+	req->no_interrupt = 0;
+
+	/*
+	 * count the request before it can complete, eth_xmit_multi() only
+	 * holds packets back while tx_qlen says a completion is coming
+	 */
+	atomic_inc(&dev->tx_qlen);
+	if (usb_ep_queue(in, req, GFP_ATOMIC) == 0) {
+		dev->net->trans_start = jiffies;
+		return;
+	}
+	atomic_dec(&dev->tx_qlen);
+
+	DBG(dev, "tx queue err\n");
+	dev->net->stats.tx_dropped++;
+	spin_lock_irqsave(&dev->req_lock, flags);
+	if (list_empty(&dev->tx_reqs))
+		netif_start_queue(dev->net);
+	list_add(&req->list, &dev->tx_reqs);
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+}
+
 static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 {
-	struct sk_buff	*skb = req->context;
+	struct sk_buff	*skb = NULL;
 	struct eth_dev	*dev = ep->driver_data;
+	struct usb_request *held = NULL;
+	int		status = req->status;
+
+	if (!tx_req_is_multi(req))
+		skb = req->context;
 
-	switch (req->status) {
+	switch (status) {
 	default:
 		dev->net->stats.tx_errors++;
-		VDBG(dev, "tx err %d\n", req->status);
+		VDBG(dev, "tx err %d\n", status);
 		/* FALLTHROUGH */
 	case -ECONNRESET:		/* unlink */
 	case -ESHUTDOWN:		/* disconnect etc */
 		break;
 	case 0:
-		dev->net->stats.tx_bytes += skb->len;
+		/* multi-packet requests were counted as they were filled */
+		if (skb)
+			dev->net->stats.tx_bytes += skb->len;
 	}
-	dev->net->stats.tx_packets++;
+	if (skb)
+		dev->net->stats.tx_packets++;
 
 	spin_lock(&dev->req_lock);
 	list_add(&req->list, &dev->tx_reqs);
+	atomic_dec(&dev->tx_qlen);
+
+	/* now there's room on the endpoint for what was held back */
+	if (status != -ECONNRESET && status != -ESHUTDOWN
+			&& netif_carrier_ok(dev->net)) {
+		held = dev->tx_held;
+		dev->tx_held = NULL;
+	}
 	spin_unlock(&dev->req_lock);
-	dev_kfree_skb_any(skb);
+	if (skb)
+		dev_kfree_skb_any(skb);
+
+	if (held)
+		tx_queue_held(dev, ep, held);
 
-	atomic_dec(&dev->tx_qlen);
 	if (netif_carrier_ok(dev->net))
 		netif_wake_queue(dev->net);
 }
 
+/*
+ * Copy a wrapped packet into the held multi-packet request, and send
+ * the request once it is full or the endpoint has nothing else queued.
+ * Otherwise it stays held until the next tx_complete().
+ */
+static netdev_tx_t eth_xmit_multi(struct eth_dev *dev, struct sk_buff *skb,
+		struct usb_ep *in, u32 max_pkts, u32 max_len)
+{
+	struct net_device	*net = dev->net;
+	struct usb_request	*req;
+	unsigned long		flags;
+	unsigned		pkts;
+
+	spin_lock_irqsave(&dev->req_lock, flags);
+	req = dev->tx_held;
+	dev->tx_held = NULL;
+	pkts = dev->tx_held_pkts;
+	if (!req) {
+		/* see eth_start_xmit() */
+		if (list_empty(&dev->tx_reqs)) {
+			spin_unlock_irqrestore(&dev->req_lock, flags);
+			return NETDEV_TX_BUSY;
+		}
+		req = container_of(dev->tx_reqs.next,
+				struct usb_request, list);
+		list_del(&req->list);
+		req->length = 0;
+		pkts = 0;
+	}
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+
+	if (!tx_req_is_multi(req)) {
+		req->buf = kmalloc(TX_MULTI_BUF_LEN, GFP_ATOMIC);
+		req->context = req->buf;
+		req->complete = tx_complete;
+	}
+
+	if (dev->wrap) {
+		spin_lock_irqsave(&dev->lock, flags);
+		if (dev->port_usb)
+			skb = dev->wrap(dev->port_usb, skb);
+		spin_unlock_irqrestore(&dev->lock, flags);
+	}
+
+	if (!skb || !req->buf || req->length + skb->len > max_len) {
+		if (skb)
+			dev_kfree_skb_any(skb);
+		net->stats.tx_dropped++;
+	} else {
+		memcpy(req->buf + req->length, skb->data, skb->len);
+		req->length += skb->len;
+		pkts++;
+		net->stats.tx_packets++;
+		net->stats.tx_bytes += skb->len;
+		dev_kfree_skb_any(skb);
+	}
+
+	spin_lock_irqsave(&dev->req_lock, flags);
+	if (!req->length) {
+		if (list_empty(&dev->tx_reqs))
+			netif_start_queue(net);
+		list_add(&req->list, &dev->tx_reqs);
+		req = NULL;
+	} else if (pkts < max_pkts && atomic_read(&dev->tx_qlen) > 0
+			&& req->length + ETH_FRAME_LEN + dev->header_len
+				<= max_len) {
+		dev->tx_held = req;
+		dev->tx_held_pkts = pkts;
+		req = NULL;
+	} else if (list_empty(&dev->tx_reqs)) {
+		/* temporarily stop TX queue when the freelist empties */
+		netif_stop_queue(net);
+	}
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+
+	if (req)
+		tx_queue_held(dev, in, req);
+	return NETDEV_TX_OK;
+}
+
 static inline int is_promisc(u16 cdc_filter)
 {
 	return cdc_filter & USB_CDC_PACKET_TYPE_PROMISCUOUS;
@@ -512,11 +698,15 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 	unsigned long		flags;
 	struct usb_ep		*in;
 	u16			cdc_filter;
+	u32			max_pkts = 0, max_len = 0;
 
 	spin_lock_irqsave(&dev->lock, flags);
 	if (dev->port_usb) {
 		in = dev->port_usb->in_ep;
 		cdc_filter = dev->port_usb->cdc_filter;
+		max_pkts = dev->port_usb->dl_max_pkts_per_xfer;
+		max_len = min_t(u32, dev->port_usb->dl_max_xfer_size,
+				TX_MULTI_BUF_LEN - 1);
 	} else {
 		in = NULL;
 		cdc_filter = 0;
@@ -550,6 +740,11 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 		/* ignores USB_CDC_PACKET_TYPE_DIRECTED */
 	}
 
+	/* batch packets only if the host takes at least two per transfer */
+	if (max_pkts > 1
+			&& max_len >= 2 * (ETH_FRAME_LEN + dev->header_len))
+		return eth_xmit_multi(dev, skb, in, max_pkts, max_len);
+
 	spin_lock_irqsave(&dev->req_lock, flags);
 	/*
 	 * this freelist can be empty if an interrupt triggered disconnect()
@@ -569,6 +764,12 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 		netif_stop_queue(net);
 	spin_unlock_irqrestore(&dev->req_lock, flags);
 
+	/* left over from multi-packet transfers */
+	if (tx_req_is_multi(req)) {
+		kfree(req->buf);
+		req->buf = NULL;
+	}
+
 	/* no buffer copies needed, unless the network stack did it
 	 * or the hardware can't use skb buffers.
 	 * or there's not enough space for extra headers we need
@@ -623,14 +824,15 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 			? ((atomic_read(&dev->tx_qlen) % qmult) != 0)
 			: 0;
 
+	atomic_inc(&dev->tx_qlen);
 	retval = usb_ep_queue(in, req, GFP_ATOMIC);
 	switch (retval) {
 	default:
 		DBG(dev, "tx queue err %d\n", retval);
+		atomic_dec(&dev->tx_qlen);
 		break;
 	case 0:
 		net->trans_start = jiffies;
-		atomic_inc(&dev->tx_qlen);
 	}
 
 	if (retval) {
@@ -666,6 +868,7 @@ static int eth_open(struct net_device *net)
 	struct gether	*link;
 
 	DBG(dev, "%s\n", __func__);
+	napi_enable(&dev->napi);
 	if (netif_carrier_ok(dev->net))
 		eth_start(dev, GFP_KERNEL);
 
@@ -685,6 +888,7 @@ static int eth_stop(struct net_device *net)
 
 	VDBG(dev, "%s\n", __func__);
 	netif_stop_queue(net);
+	napi_disable(&dev->napi);
 
 	DBG(dev, "stop stats: rx/tx %ld/%ld, errs %ld/%ld\n",
 		dev->net->stats.rx_packets, dev->net->stats.tx_packets,
@@ -718,6 +922,9 @@ static int eth_stop(struct net_device *net)
 	}
 	spin_unlock_irqrestore(&dev->lock, flags);
 
+	/* nothing polls for these any more */
+	skb_queue_purge(&dev->rx_frames);
+
 	return 0;
 }
 
@@ -806,6 +1013,7 @@ int gether_setup(struct usb_gadget *g, u8 ethaddr[ETH_ALEN])
 
 	/* network device setup */
 	dev->net = net;
+	netif_napi_add(net, &dev->napi, eth_poll, ETH_NAPI_WEIGHT);
 	strcpy(net->name, "usb%d");
 
 	if (get_ether_addr(dev_addr, net->dev_addr))
@@ -979,12 +1187,18 @@ void gether_disconnect(struct gether *link)
 	 */
 	usb_ep_disable(link->in_ep);
 	spin_lock(&dev->req_lock);
+	if (dev->tx_held) {
+		list_add(&dev->tx_held->list, &dev->tx_reqs);
+		dev->tx_held = NULL;
+	}
 	while (!list_empty(&dev->tx_reqs)) {
 		req = container_of(dev->tx_reqs.next,
 					struct usb_request, list);
 		list_del(&req->list);
 
 		spin_unlock(&dev->req_lock);
+		if (tx_req_is_multi(req))
+			kfree(req->buf);
 		usb_ep_free_request(link->in_ep, req);
 		spin_lock(&dev->req_lock);
 	}
@@ -68,6 +68,17 @@ struct gether {
 						struct sk_buff *skb,
 						struct sk_buff_head *list);
 
+	/*
+	 * Multi-packet transfers, for framings that can tell packets
+	 * apart: OUT requests are sized for ul_max_pkts_per_xfer
+	 * packets, and up to dl_max_pkts_per_xfer packets are copied
+	 * into one IN request of at most dl_max_xfer_size bytes.
+	 * 0 or 1 means one packet per transfer.
+	 */
+	u32				ul_max_pkts_per_xfer;
+	u32				dl_max_pkts_per_xfer;
+	u32				dl_max_xfer_size;
+
 	/* called on network open/close */
 	void				(*open)(struct gether *);
 	void				(*close)(struct gether *);
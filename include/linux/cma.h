@@ -0,0 +1,60 @@
+#ifndef __LINUX_CMA_H
+#define __LINUX_CMA_H
+/*
+ * Contiguous Memory Allocator
+ *
+ * Areas reserved at boot which the page allocator uses for movable pages
+ * until a driver asks for a physically contiguous buffer out of them.
+ * See Documentation/vm/cma.txt.
+ */
+
+#include <linux/errno.h>
+#include <linux/types.h>
+
+struct cma;
+struct page;
+
+#ifdef CONFIG_CMA
+
+extern int cma_declare_contiguous(phys_addr_t base, phys_addr_t size,
+				  const char *name, struct cma **res_cma);
+extern void cma_reserve_default(void);
+
+extern struct cma *cma_find(const char *name);
+extern struct page *cma_alloc(struct cma *cma, unsigned long count,
+			      unsigned int align);
+extern bool cma_release(struct cma *cma, struct page *pages,
+			unsigned long count);
+
+#else
+
+static inline int cma_declare_contiguous(phys_addr_t base, phys_addr_t size,
+					 const char *name, struct cma **res_cma)
+{
+	return -ENOSYS;
+}
+
+static inline void cma_reserve_default(void)
+{
+}
+
+static inline struct cma *cma_find(const char *name)
+{
+	return NULL;
+}
+
+static inline struct page *cma_alloc(struct cma *cma, unsigned long count,
+				     unsigned int align)
+{
+	return NULL;
+}
+
+static inline bool cma_release(struct cma *cma, struct page *pages,
+			       unsigned long count)
+{
+	return false;
+}
+
+#endif /* CONFIG_CMA */
+
+#endif /* __LINUX_CMA_H */
@@ -18,6 +18,7 @@
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
 #include <linux/list.h>
+#include <linux/ktime.h>
 #endif
 
 /* The early_suspend structure defines suspend and resume hooks to be called
@@ -25,7 +26,10 @@
  * control the order. They can be used to turn off the screen and input
  * devices that are not used for wakeup.
  * Suspend handlers are called in low to high level order, resume handlers are
- * called in the opposite order. If, when calling register_early_suspend,
+ * called in the opposite order. Handlers of the same level run in
+ * registration order, except that those with async set may run at the same
+ * time as the other async handlers of their level, each in its own thread.
+ * If, when calling register_early_suspend,
  * the suspend handlers have already been called without a matching call to the
  * resume handlers, the suspend handler will be called directly from
  * register_early_suspend. This direct call can violate the normal level order.
@@ -41,6 +45,11 @@ struct early_suspend {
 	int level;
 	void (*suspend)(struct early_suspend *h);
 	void (*resume)(struct early_suspend *h);
+	/* shares no state with the other handlers of its level */
+	bool async;
+	/* how long the handlers took last time, for debugfs */
+	ktime_t suspend_time;
+	ktime_t resume_time;
 #endif
 };
 
@@ -319,6 +319,9 @@ extern unsigned long get_zeroed_page(gfp_t gfp_mask);
 void *alloc_pages_exact(size_t size, gfp_t gfp_mask);
 void free_pages_exact(void *virt, size_t size);
 
+unsigned long alloc_pages_bulk(gfp_t gfp_mask, unsigned int order,
+			       unsigned long nr_pages, struct page **pages);
+
 #define __get_free_page(gfp_mask) \
 		__get_free_pages((gfp_mask), 0)
 
@@ -328,6 +331,9 @@ void free_pages_exact(void *virt, size_t size);
 extern void __free_pages(struct page *page, unsigned int order);
 extern void free_pages(unsigned long addr, unsigned int order);
 extern void free_hot_cold_page(struct page *page, int cold);
+extern void free_hot_cold_page_list(struct list_head *list, int cold);
+extern void free_pages_bulk(unsigned long nr_pages, struct page **pages,
+			    unsigned int order);
 
 #define __free_page(page) __free_pages((page), 0)
 #define free_page(addr) free_pages((addr), 0)
@@ -342,4 +348,14 @@ extern gfp_t gfp_allowed_mask;
 extern void set_gfp_allowed_mask(gfp_t mask);
 extern gfp_t clear_gfp_allowed_mask(gfp_t mask);
 
+#ifdef CONFIG_CMA
+/* The below functions must be run on a range from a single zone. */
+extern int alloc_contig_range(unsigned long start_pfn, unsigned long end_pfn,
+			      unsigned migratetype);
+extern void free_contig_range(unsigned long pfn, unsigned long nr_pages);
+
+/* Called by mm/cma.c to hand its reserved areas to the allocator */
+extern void init_cma_reserved_pageblock(struct page *page);
+#endif
+
 #endif /* __LINUX_GFP_H */
@@ -431,6 +431,7 @@ extern struct xt_table_info *xt_replace_table(struct xt_table *table,
 					      unsigned int num_counters,
 					      struct xt_table_info *newinfo,
 					      int *error);
+extern atomic_t xt_table_generation;
 
 extern struct xt_match *xt_find_match(u8 af, const char *name, u8 revision);
 extern struct xt_target *xt_find_target(u8 af, const char *name, u8 revision);
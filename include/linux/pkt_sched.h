@@ -481,4 +481,22 @@ struct tc_drr_stats {
 	__u32	deficit;
 };
 
+/* RADIO section */
+
+struct tc_radio_qopt {
+	__u32	limit;		/* Queue length in packets */
+	__u32	tail;		/* Radio stays up this long after traffic, usecs */
+	__u32	max_delay;	/* Longest a background packet is held, usecs */
+	__u8	priomap[TC_PRIO_MAX+1];	/* 1 marks background priorities */
+};
+
+struct tc_radio_xstats {
+	__u64	total_latency;	/* Sum of background holding times, usecs */
+	__u32	packets;	/* Background packets sent */
+	__u32	bursts;		/* Held packets released with radio activity */
+	__u32	wakeups;	/* Radio wakeups forced by max_delay */
+	__u32	wakeups_saved;
+	__u32	max_latency;	/* usecs */
+};
+
 #endif
@@ -18,6 +18,7 @@
 
 #include <linux/list.h>
 #include <linux/ktime.h>
+#include <linux/timer.h>
 
 /* A wake_lock prevents the system from entering suspend or other low power
  * states when active. If the type is set to WAKE_LOCK_SUSPEND, the wake_lock
@@ -32,12 +33,16 @@ enum {
 	WAKE_LOCK_TYPE_COUNT
 };
 
+/* Buckets of the hold time histogram: <1ms, <10ms, ... <100s, longer */
+#define WAKE_LOCK_HIST_BUCKETS	7
+
 struct wake_lock {
 #ifdef CONFIG_HAS_WAKELOCK
 	struct list_head    link;
 	int                 flags;
 	const char         *name;
 	unsigned long       expires;
+	struct timer_list   timer;
 #ifdef CONFIG_WAKELOCK_STAT
 	struct {
 		int             count;
@@ -45,8 +50,10 @@ struct wake_lock {
 		int             wakeup_count;
 		ktime_t         total_time;
 		ktime_t         prevent_suspend_time;
+		ktime_t         prevent_suspend_start;
 		ktime_t         max_time;
 		ktime_t         last_time;
+		int             hist[WAKE_LOCK_HIST_BUCKETS];
 	} stat;
 #endif
 #endif
@@ -68,8 +75,8 @@ int wake_lock_active(struct wake_lock *lock);
 
 /* has_wake_lock returns 0 if no wake locks of the specified type are active,
  * and non-zero if one or more wake locks are held. Specifically it returns
- * -1 if one or more wake locks with no timeout are active or the
- * number of jiffies until all active wake locks time out.
+ * -1 if one or more wake locks with no timeout are active or an upper bound
+ * on the number of jiffies until all active wake locks time out.
  */
 long has_wake_lock(int type);
 
@@ -182,35 +182,51 @@ static inline void destroy_work_on_stack(struct work_struct *work) { }
 
 extern struct workqueue_struct *
 __create_workqueue_key(const char *name, int singlethread,
-		       int freezeable, int rt, struct lock_class_key *key,
-		       const char *lock_name);
+		       int freezeable, int rt, int reclaim,
+		       struct lock_class_key *key, const char *lock_name);
 
 #ifdef CONFIG_LOCKDEP
-#define __create_workqueue(name, singlethread, freezeable, rt)	\
-({								\
-	static struct lock_class_key __key;			\
-	const char *__lock_name;				\
-								\
-	if (__builtin_constant_p(name))				\
-		__lock_name = (name);				\
-	else							\
-		__lock_name = #name;				\
-								\
-	__create_workqueue_key((name), (singlethread),		\
-			       (freezeable), (rt), &__key,	\
-			       __lock_name);			\
+#define __create_workqueue_reclaim(name, singlethread, freezeable, rt,	\
+				   reclaim)				\
+({									\
+	static struct lock_class_key __key;				\
+	const char *__lock_name;					\
+									\
+	if (__builtin_constant_p(name))					\
+		__lock_name = (name);					\
+	else								\
+		__lock_name = #name;					\
+									\
+	__create_workqueue_key((name), (singlethread),			\
+			       (freezeable), (rt), (reclaim), &__key,	\
+			       __lock_name);				\
 })
 #else
-#define __create_workqueue(name, singlethread, freezeable, rt)	\
+#define __create_workqueue_reclaim(name, singlethread, freezeable, rt,	\
+				   reclaim)				\
 	__create_workqueue_key((name), (singlethread), (freezeable), (rt), \
-			       NULL, NULL)
+			       (reclaim), NULL, NULL)
 #endif
 
+#define __create_workqueue(name, singlethread, freezeable, rt)		\
+	__create_workqueue_reclaim((name), (singlethread), (freezeable), \
+				   (rt), 0)
+
 #define create_workqueue(name) __create_workqueue((name), 0, 0, 0)
 #define create_rt_workqueue(name) __create_workqueue((name), 0, 0, 1)
 #define create_freezeable_workqueue(name) __create_workqueue((name), 1, 1, 0)
 #define create_singlethread_workqueue(name) __create_workqueue((name), 1, 0, 0)
 
+/*
+ * Plain workqueues are served by per-cpu pools of shared workers, which
+ * may have to fork a new worker before a queued item runs.  Workqueues
+ * which the memory reclaim path waits on keep dedicated threads.
+ */
+#define create_reclaim_workqueue(name)					\
+	__create_workqueue_reclaim((name), 0, 0, 0, 1)
+#define create_singlethread_reclaim_workqueue(name)			\
+	__create_workqueue_reclaim((name), 1, 0, 0, 1)
+
 extern void destroy_workqueue(struct workqueue_struct *wq);
 
 extern int queue_work(struct workqueue_struct *wq, struct work_struct *work);
@@ -31,6 +31,10 @@
 #define HCI_PROTO_L2CAP	0
 #define HCI_PROTO_SCO	1
 
+/* ACL links are served by the skb->priority of their next frame,
+ * 0 (bulk) to HCI_PRIO_MAX */
+#define HCI_PRIO_MAX	7
+
 /* HCI Core structures */
 struct inquiry_data {
 	bdaddr_t	bdaddr;
@@ -182,6 +186,7 @@ struct hci_conn {
 	unsigned long	 pend;
 
 	unsigned int	 sent;
+	__u8		 tx_served;	/* got a quota this tx round */
 
 	struct sk_buff_head data_q;
 
@@ -0,0 +1,34 @@
+/*
+ * Per-UID and per-tag accounting of socket traffic, see net/socktag.c
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ */
+
+#ifndef __socktag_h
+#define __socktag_h
+
+#include <net/sock.h>
+
+#define SOCKTAG_RX	0
+#define SOCKTAG_TX	1
+
+#ifdef CONFIG_NET_SOCKTAG
+extern int socktag_enabled;
+
+void __socktag_charge(struct sock *sk, int dir, int bytes);
+void socktag_sk_free(struct sock *sk);
+
+static inline void socktag_charge(struct sock *sk, int dir, int bytes)
+{
+	if (bytes > 0 && socktag_enabled && sk &&
+	    (sk->sk_family == AF_INET || sk->sk_family == AF_INET6))
+		__socktag_charge(sk, dir, bytes);
+}
+#else
+static inline void socktag_charge(struct sock *sk, int dir, int bytes) {}
+static inline void socktag_sk_free(struct sock *sk) {}
+#endif
+
+#endif /* __socktag_h */
@@ -0,0 +1,56 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM wakelock
+
+#if !defined(_TRACE_WAKELOCK_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_WAKELOCK_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(wake_lock,
+
+	TP_PROTO(const char *name, int type, long timeout),
+
+	TP_ARGS(name, type, timeout),
+
+	TP_STRUCT__entry(
+		__string(	name,		name		)
+		__field(	int,		type		)
+		__field(	long,		timeout		)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, name);
+		__entry->type = type;
+		__entry->timeout = timeout;
+	),
+
+	TP_printk("name=%s type=%d timeout=%ld",
+		  __get_str(name), __entry->type, __entry->timeout)
+);
+
+TRACE_EVENT(wake_unlock,
+
+	TP_PROTO(const char *name, int type, int expired),
+
+	TP_ARGS(name, type, expired),
+
+	TP_STRUCT__entry(
+		__string(	name,		name		)
+		__field(	int,		type		)
+		__field(	int,		expired		)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, name);
+		__entry->type = type;
+		__entry->expired = expired;
+	),
+
+	TP_printk("name=%s type=%d expired=%d",
+		  __get_str(name), __entry->type, __entry->expired)
+);
+
+#endif /* _TRACE_WAKELOCK_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -975,6 +975,7 @@ NORET_TYPE void do_exit(long code)
 	exit_fs(tsk);
 	check_stack_usage();
 	exit_thread();
+	sched_autogroup_exit_task(tsk);
 	cgroup_exit(tsk, 1);
 
 	if (group_dead)
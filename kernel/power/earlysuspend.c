@@ -13,14 +13,16 @@
  *
  */
 
+#include <linux/async.h>
+#include <linux/debugfs.h>
 #include <linux/earlysuspend.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/seq_file.h>
 #include <linux/rtc.h>
 #include <linux/syscalls.h> /* sys_sync */
 #include <linux/wakelock.h>
 #include <linux/workqueue.h>
-#include <linux/elf.h>
 
 #include "power.h"
 
@@ -50,6 +52,11 @@ enum {
 };
 static int state;
 
+/* handlers of one level run in parallel in this domain */
+static LIST_HEAD(early_suspend_domain);
+static ktime_t early_suspend_time;
+static ktime_t late_resume_time;
+
 static void sync_system(struct work_struct *work)
 {
     pr_info("%s +\n", __func__);
@@ -85,13 +92,75 @@ void unregister_early_suspend(struct early_suspend *handler)
 }
 EXPORT_SYMBOL(unregister_early_suspend);
 
+static bool early_suspend_async(void)
+{
+#ifdef CONFIG_PM_SLEEP
+	return pm_async_enabled;
+#else
+	return false;
+#endif
+}
+
+static void early_suspend_call(void *data, async_cookie_t cookie)
+{
+	struct early_suspend *h = data;
+	ktime_t start = ktime_get();
+
+	if (debug_mask & DEBUG_SUSPEND)
+		pr_info("++ early suspend = %pf\n", h->suspend);
+
+	h->suspend(h);
+	h->suspend_time = ktime_sub(ktime_get(), start);
+
+	if (debug_mask & DEBUG_SUSPEND)
+		pr_info("-- early suspend = %pf (%lld us)\n", h->suspend,
+			ktime_to_us(h->suspend_time));
+}
+
+static void late_resume_call(void *data, async_cookie_t cookie)
+{
+	struct early_suspend *h = data;
+	ktime_t start = ktime_get();
+
+	if (debug_mask & DEBUG_SUSPEND)
+		pr_info("++ late_resume = %pf\n", h->resume);
+
+	h->resume(h);
+	h->resume_time = ktime_sub(ktime_get(), start);
+
+	if (debug_mask & DEBUG_SUSPEND)
+		pr_info("-- late_resume = %pf (%lld us)\n", h->resume,
+			ktime_to_us(h->resume_time));
+}
+
+/*
+ * Run one handler.  A level is only started once the handlers of the
+ * previous one have all returned, so levels keep their order.  Within a
+ * level, handlers which set async overlap; the others wait for whatever
+ * was started before them, so they keep their registration order.
+ * Called with early_suspend_lock held.
+ */
+static void early_suspend_run(async_func_ptr *func, struct early_suspend *h,
+			      int *level)
+{
+	if (h->level != *level || !h->async) {
+		async_synchronize_full_domain(&early_suspend_domain);
+		*level = h->level;
+	}
+
+	if (h->async && early_suspend_async())
+		async_schedule_domain(func, h, &early_suspend_domain);
+	else
+		func(h, 0);
+}
+
 static void early_suspend(struct work_struct *work)
 {
 	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
-
-	char symname[KSYM_NAME_LEN];
+	ktime_t start;
+	int level;
 
 	mutex_lock(&early_suspend_lock);
 	spin_lock_irqsave(&state_lock, irqflags);
@@ -111,23 +180,21 @@ static void early_suspend(struct work_struct *work)
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("early_suspend: call handlers\n");
 
+	start = ktime_get();
+	level = INT_MIN;
 	list_for_each_entry(pos, &early_suspend_handlers, link) {
-		if (pos->suspend != NULL) {
-
-			if (debug_mask & DEBUG_SUSPEND) {
-				lookup_symbol_name(pos->suspend, symname);
-				pr_info("++ early suspend = %s\n", symname);
-			}
-
-			pos->suspend(pos);
-
-			if (debug_mask & DEBUG_SUSPEND)
-				pr_info("-- early suspend = %s\n", symname);
-		}
+		if (pos->suspend != NULL)
+			early_suspend_run(early_suspend_call, pos, &level);
 	}
+	async_synchronize_full_domain(&early_suspend_domain);
+	early_suspend_time = ktime_sub(ktime_get(), start);
 
 	mutex_unlock(&early_suspend_lock);
 
+	if (debug_mask & DEBUG_SUSPEND)
+		pr_info("early_suspend: handlers done in %lld us\n",
+			ktime_to_us(early_suspend_time));
+
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("early_suspend: sync\n");
 #if 0
@@ -149,8 +216,8 @@ static void late_resume(struct work_struct *work)
 	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
-
-	char symname[KSYM_NAME_LEN];
+	ktime_t start;
+	int level;
 
 	mutex_lock(&early_suspend_lock);
 	spin_lock_irqsave(&state_lock, irqflags);
@@ -168,22 +235,18 @@ static void late_resume(struct work_struct *work)
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("late_resume: call handlers\n");
 
-	list_for_each_entry_reverse(pos, &early_suspend_handlers, link)
-		if (pos->resume != NULL) {
-
-			if (debug_mask & DEBUG_SUSPEND) {
-				lookup_symbol_name(pos->suspend, symname);
-				pr_info("++ late_resume = %s\n", symname);
-			}
-
-			pos->resume(pos);
-
-			if (debug_mask & DEBUG_SUSPEND)
-				pr_info("-- late_resume = %s\n", symname);
-		}
+	start = ktime_get();
+	level = INT_MIN;
+	list_for_each_entry_reverse(pos, &early_suspend_handlers, link) {
+		if (pos->resume != NULL)
+			early_suspend_run(late_resume_call, pos, &level);
+	}
+	async_synchronize_full_domain(&early_suspend_domain);
+	late_resume_time = ktime_sub(ktime_get(), start);
 
 	if (debug_mask & DEBUG_SUSPEND)
-		pr_info("late_resume: done\n");
+		pr_info("late_resume: done in %lld us\n",
+			ktime_to_us(late_resume_time));
 abort:
 	mutex_unlock(&early_suspend_lock);
 }
@@ -224,3 +287,44 @@ suspend_state_t get_suspend_state(void)
 {
 	return requested_suspend_state;
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int early_suspend_stats_show(struct seq_file *m, void *unused)
+{
+	struct early_suspend *pos;
+
+	mutex_lock(&early_suspend_lock);
+	seq_printf(m, "early_suspend %lld us, late_resume %lld us\n",
+		   ktime_to_us(early_suspend_time),
+		   ktime_to_us(late_resume_time));
+	seq_puts(m, "level\tsuspend_us\tresume_us\thandler\n");
+	list_for_each_entry(pos, &early_suspend_handlers, link)
+		seq_printf(m, "%d\t%lld\t%lld\t%pf\n", pos->level,
+			   ktime_to_us(pos->suspend_time),
+			   ktime_to_us(pos->resume_time),
+			   pos->suspend ? (void *)pos->suspend :
+					  (void *)pos->resume);
+	mutex_unlock(&early_suspend_lock);
+	return 0;
+}
+
+static int early_suspend_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, early_suspend_stats_show, NULL);
+}
+
+static const struct file_operations early_suspend_stats_fops = {
+	.open = early_suspend_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init early_suspend_debugfs_init(void)
+{
+	debugfs_create_file("early_suspend", S_IRUGO, NULL, NULL,
+			    &early_suspend_stats_fops);
+	return 0;
+}
+late_initcall(early_suspend_debugfs_init);
+#endif
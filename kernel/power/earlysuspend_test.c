@@ -0,0 +1,195 @@
+/*
+ * kernel/power/earlysuspend_test.c - Early suspend ordering test.
+ *
+ * This file is released under the GPLv2.
+ *
+ * Registers synthetic early suspend handlers at the three standard
+ * levels, some of them async, each sleeping for delay_ms.  Every time
+ * the screen goes off or on, the timestamps of the pass are checked
+ * against the rules of earlysuspend.h: a handler may only overlap the
+ * handlers run before it if both are async and of the same level.  The
+ * result is logged together with the time the pass took and the sum of
+ * the handler times, which it would have taken without async handlers.
+ */
+
+#include <linux/delay.h>
+#include <linux/earlysuspend.h>
+#include <linux/hrtimer.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+
+static unsigned int delay_ms = 20;
+module_param(delay_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(delay_ms, "Time each synthetic handler sleeps");
+
+enum { TEST_SUSPEND, TEST_RESUME };
+
+struct es_test_handler {
+	struct early_suspend es;
+	ktime_t start[2];
+	ktime_t end[2];
+};
+
+#define ES_TEST(_level, _async) \
+	{ .es = { .level = EARLY_SUSPEND_LEVEL_##_level, .async = _async } }
+
+/* in suspend order, resume runs backwards */
+static struct es_test_handler handlers[] = {
+	ES_TEST(BLANK_SCREEN, true),
+	ES_TEST(BLANK_SCREEN, true),
+	ES_TEST(BLANK_SCREEN, false),
+	ES_TEST(BLANK_SCREEN, true),
+	ES_TEST(STOP_DRAWING, true),
+	ES_TEST(STOP_DRAWING, true),
+	ES_TEST(DISABLE_FB, false),
+	ES_TEST(DISABLE_FB, true),
+	ES_TEST(DISABLE_FB, true),
+};
+
+static void es_test_run(struct early_suspend *h, int phase)
+{
+	struct es_test_handler *t = container_of(h, struct es_test_handler, es);
+
+	t->start[phase] = ktime_get();
+	msleep(delay_ms);
+	t->end[phase] = ktime_get();
+}
+
+static void es_test_suspend(struct early_suspend *h)
+{
+	es_test_run(h, TEST_SUSPEND);
+}
+
+static void es_test_resume(struct early_suspend *h)
+{
+	es_test_run(h, TEST_RESUME);
+}
+
+static struct es_test_handler *es_test_nth(int phase, int i)
+{
+	if (phase == TEST_RESUME)
+		i = ARRAY_SIZE(handlers) - 1 - i;
+	return &handlers[i];
+}
+
+static void es_test_begin(int phase)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(handlers); i++) {
+		handlers[i].start[phase] = ktime_set(0, 0);
+		handlers[i].end[phase] = ktime_set(0, 0);
+	}
+}
+
+static void es_test_check(int phase)
+{
+	const char *name = phase == TEST_SUSPEND ? "suspend" : "resume";
+	struct es_test_handler *a, *b;
+	s64 first = 0, last = 0, sum = 0;
+	int i, j, errors = 0;
+
+	for (i = 0; i < ARRAY_SIZE(handlers); i++) {
+		a = es_test_nth(phase, i);
+		if (!ktime_to_ns(a->end[phase])) {
+			pr_info("earlysuspend_test: %s: incomplete pass\n",
+				name);
+			return;
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(handlers); i++) {
+		a = es_test_nth(phase, i);
+		for (j = i + 1; j < ARRAY_SIZE(handlers); j++) {
+			b = es_test_nth(phase, j);
+			if (a->es.async && b->es.async &&
+			    a->es.level == b->es.level)
+				continue;
+			if (ktime_to_ns(b->start[phase]) <
+			    ktime_to_ns(a->end[phase])) {
+				pr_err("earlysuspend_test: %s: handler %d "
+				       "(level %d) started before handler %d "
+				       "(level %d) returned\n", name,
+				       (int)(b - handlers), b->es.level,
+				       (int)(a - handlers), a->es.level);
+				errors++;
+			}
+		}
+
+		if (!i || ktime_to_ns(a->start[phase]) < first)
+			first = ktime_to_ns(a->start[phase]);
+		if (ktime_to_ns(a->end[phase]) > last)
+			last = ktime_to_ns(a->end[phase]);
+		sum += ktime_to_ns(ktime_sub(a->end[phase], a->start[phase]));
+	}
+
+	pr_info("earlysuspend_test: %s: %s, %d handlers took %lld us, "
+		"%lld us serially\n", name, errors ? "FAILED" : "ok",
+		(int)ARRAY_SIZE(handlers), div_s64(last - first, NSEC_PER_USEC),
+		div_s64(sum, NSEC_PER_USEC));
+}
+
+/* synchronous, so they run before or after all the handlers above */
+static void es_test_first_suspend(struct early_suspend *h)
+{
+	es_test_begin(TEST_SUSPEND);
+}
+
+static void es_test_first_resume(struct early_suspend *h)
+{
+	es_test_check(TEST_RESUME);
+}
+
+static void es_test_last_suspend(struct early_suspend *h)
+{
+	es_test_check(TEST_SUSPEND);
+}
+
+static void es_test_last_resume(struct early_suspend *h)
+{
+	es_test_begin(TEST_RESUME);
+}
+
+static struct early_suspend es_test_first = {
+	.level = EARLY_SUSPEND_LEVEL_BLANK_SCREEN - 1,
+	.suspend = es_test_first_suspend,
+	.resume = es_test_first_resume,
+};
+
+static struct early_suspend es_test_last = {
+	.level = EARLY_SUSPEND_LEVEL_DISABLE_FB + 1,
+	.suspend = es_test_last_suspend,
+	.resume = es_test_last_resume,
+};
+
+static int __init es_test_init(void)
+{
+	int i;
+
+	register_early_suspend(&es_test_first);
+	for (i = 0; i < ARRAY_SIZE(handlers); i++) {
+		handlers[i].es.suspend = es_test_suspend;
+		handlers[i].es.resume = es_test_resume;
+		register_early_suspend(&handlers[i].es);
+	}
+	register_early_suspend(&es_test_last);
+
+	return 0;
+}
+
+static void __exit es_test_exit(void)
+{
+	int i;
+
+	unregister_early_suspend(&es_test_last);
+	for (i = ARRAY_SIZE(handlers) - 1; i >= 0; i--)
+		unregister_early_suspend(&handlers[i].es);
+	unregister_early_suspend(&es_test_first);
+}
+
+module_init(es_test_init);
+module_exit(es_test_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Early suspend ordering test");
@@ -184,6 +184,7 @@ static inline void suspend_test_finish(const char *label) {}
 #ifdef CONFIG_PM_SLEEP
 /* kernel/power/main.c */
 extern int pm_notifier_call_chain(unsigned long val);
+extern int pm_async_enabled;
 #endif
 
 #ifdef CONFIG_HIGHMEM
@@ -17,13 +17,15 @@
 #include <linux/platform_device.h>
 #include <linux/rtc.h>
 #include <linux/suspend.h>
-#include <linux/syscalls.h> /* sys_sync */
 #include <linux/wakelock.h>
 #ifdef CONFIG_WAKELOCK_STAT
 #include <linux/proc_fs.h>
 #endif
 #include "power.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/wakelock.h>
+
 enum {
 	DEBUG_EXIT_SUSPEND = 1U << 0,
 	DEBUG_WAKEUP = 1U << 1,
@@ -43,6 +45,10 @@ module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 static DEFINE_SPINLOCK(list_lock);
 static LIST_HEAD(inactive_locks);
 static struct list_head active_wake_locks[WAKE_LOCK_TYPE_COUNT];
+/* has_wake_lock() answers from these instead of walking the lists */
+static int nr_active[WAKE_LOCK_TYPE_COUNT];	/* timed or not */
+static int nr_untimed[WAKE_LOCK_TYPE_COUNT];
+static unsigned long max_expires[WAKE_LOCK_TYPE_COUNT];
 static int current_event_num;
 struct workqueue_struct *suspend_work_queue;
 struct workqueue_struct *sync_work_queue;
@@ -53,7 +59,6 @@ static struct wake_lock unknown_wakeup;
 
 #ifdef CONFIG_WAKELOCK_STAT
 static struct wake_lock deleted_wake_locks;
-static ktime_t last_sleep_time_update;
 static int wait_for_wakeup;
 
 int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
@@ -90,6 +95,7 @@ static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 	ktime_t active_time = ktime_set(0, 0);
 	ktime_t total_time = lock->stat.total_time;
 	ktime_t max_time = lock->stat.max_time;
+	int i;
 
 	ktime_t prevent_suspend_time = lock->stat.prevent_suspend_time;
 	if (lock->flags & WAKE_LOCK_ACTIVE) {
@@ -106,18 +112,20 @@ static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 		total_time = ktime_add(total_time, add_time);
 		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND)
 			prevent_suspend_time = ktime_add(prevent_suspend_time,
-					ktime_sub(now, last_sleep_time_update));
+				ktime_sub(now, lock->stat.prevent_suspend_start));
 		if (add_time.tv64 > max_time.tv64)
 			max_time = add_time;
 	}
 
-	return seq_printf(m,
-		     "\"%s\"\t%d\t%d\t%d\t%lld\t%lld\t%lld\t%lld\t%lld\n",
-		     lock->name, lock_count, expire_count,
-		     lock->stat.wakeup_count, ktime_to_ns(active_time),
-		     ktime_to_ns(total_time),
-		     ktime_to_ns(prevent_suspend_time), ktime_to_ns(max_time),
-		     ktime_to_ns(lock->stat.last_time));
+	seq_printf(m, "\"%s\"\t%d\t%d\t%d\t%lld\t%lld\t%lld\t%lld\t%lld",
+		   lock->name, lock_count, expire_count,
+		   lock->stat.wakeup_count, ktime_to_ns(active_time),
+		   ktime_to_ns(total_time),
+		   ktime_to_ns(prevent_suspend_time), ktime_to_ns(max_time),
+		   ktime_to_ns(lock->stat.last_time));
+	for (i = 0; i < WAKE_LOCK_HIST_BUCKETS; i++)
+		seq_printf(m, "%c%d", i ? ',' : '\t', lock->stat.hist[i]);
+	return seq_putc(m, '\n');
 }
 
 static int wakelock_stats_show(struct seq_file *m, void *unused)
@@ -130,7 +138,8 @@ static int wakelock_stats_show(struct seq_file *m, void *unused)
 	spin_lock_irqsave(&list_lock, irqflags);
 
 	ret = seq_puts(m, "name\tcount\texpire_count\twake_count\tactive_since"
-			"\ttotal_time\tsleep_time\tmax_time\tlast_change\n");
+			"\ttotal_time\tsleep_time\tmax_time\tlast_change"
+			"\thold_hist\n");
 	list_for_each_entry(lock, &inactive_locks, link)
 		ret = print_lock_stat(m, lock);
 	for (type = 0; type < WAKE_LOCK_TYPE_COUNT; type++) {
@@ -141,6 +150,28 @@ static int wakelock_stats_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static void wake_lock_hist_add(struct wake_lock *lock, ktime_t duration)
+{
+	s64 limit = NSEC_PER_MSEC;
+	int i;
+
+	for (i = 0; i < WAKE_LOCK_HIST_BUCKETS - 1; i++, limit *= 10)
+		if (ktime_to_ns(duration) < limit)
+			break;
+	lock->stat.hist[i]++;
+}
+
+static void stop_preventing_suspend_locked(struct wake_lock *lock, ktime_t end)
+{
+	if (!(lock->flags & WAKE_LOCK_PREVENTING_SUSPEND))
+		return;
+	lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
+	if (end.tv64 > lock->stat.prevent_suspend_start.tv64)
+		lock->stat.prevent_suspend_time = ktime_add(
+			lock->stat.prevent_suspend_time,
+			ktime_sub(end, lock->stat.prevent_suspend_start));
+}
+
 static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 {
 	ktime_t duration;
@@ -158,51 +189,67 @@ static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 	lock->stat.total_time = ktime_add(lock->stat.total_time, duration);
 	if (ktime_to_ns(duration) > ktime_to_ns(lock->stat.max_time))
 		lock->stat.max_time = duration;
+	wake_lock_hist_add(lock, duration);
 	lock->stat.last_time = ktime_get();
-	if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-		duration = ktime_sub(now, last_sleep_time_update);
-		lock->stat.prevent_suspend_time = ktime_add(
-			lock->stat.prevent_suspend_time, duration);
-		lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
-	}
+	stop_preventing_suspend_locked(lock, now);
+}
+
+static void start_preventing_suspend_locked(struct wake_lock *lock,
+					    ktime_t now)
+{
+	if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND)
+		return;
+	lock->flags |= WAKE_LOCK_PREVENTING_SUSPEND;
+	lock->stat.prevent_suspend_start = now;
 }
 
+/*
+ * Called when main_wake_lock changes state: everything active starts or
+ * stops holding up suspend.  Other locks do this one at a time as they
+ * are taken and released, so only this walks the list.
+ */
 static void update_sleep_wait_stats_locked(int done)
 {
 	struct wake_lock *lock;
-	ktime_t now, etime, elapsed, add;
+	ktime_t now, etime;
 	int expired;
 
 	now = ktime_get();
-	elapsed = ktime_sub(now, last_sleep_time_update);
 	list_for_each_entry(lock, &active_wake_locks[WAKE_LOCK_SUSPEND], link) {
 		expired = get_expired_time(lock, &etime);
-		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-			if (expired)
-				add = ktime_sub(etime, last_sleep_time_update);
-			else
-				add = elapsed;
-			lock->stat.prevent_suspend_time = ktime_add(
-				lock->stat.prevent_suspend_time, add);
-		}
-		if (done || expired)
-			lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
-		else
-			lock->flags |= WAKE_LOCK_PREVENTING_SUSPEND;
+		if (done)
+			stop_preventing_suspend_locked(lock,
+						       expired ? etime : now);
+		else if (!expired)
+			start_preventing_suspend_locked(lock, now);
 	}
-	last_sleep_time_update = now;
 }
 #endif
 
 
+/* Caller must acquire the list_lock spinlock */
+static void deactivate_wake_lock(struct wake_lock *lock)
+{
+	int type = lock->flags & WAKE_LOCK_TYPE_MASK;
+
+	if (!(lock->flags & WAKE_LOCK_ACTIVE))
+		return;
+	if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+		del_timer(&lock->timer);
+	else
+		nr_untimed[type]--;
+	nr_active[type]--;
+	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
+	list_move(&lock->link, &inactive_locks);
+}
+
 static void expire_wake_lock(struct wake_lock *lock)
 {
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_unlock_stat_locked(lock, 1);
 #endif
-	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
-	list_del(&lock->link);
-	list_add(&lock->link, &inactive_locks);
+	deactivate_wake_lock(lock);
+	trace_wake_unlock(lock->name, lock->flags & WAKE_LOCK_TYPE_MASK, 1);
 	if (debug_mask & (DEBUG_WAKE_LOCK | DEBUG_EXPIRE))
 		pr_info("expired wake lock %s\n", lock->name);
 }
@@ -273,23 +320,22 @@ endofprint:
 }
 EXPORT_SYMBOL(debug_print_active_locks);
 
+/*
+ * Timed locks leave through their own timers, so an expired lock counts
+ * as held until its timer has run.  The timeout returned can be too long
+ * if the lock that would have timed out last was released early.
+ */
 static long has_wake_lock_locked(int type)
 {
-	struct wake_lock *lock, *n;
-	long max_timeout = 0;
+	long timeout;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout <= 0)
-				expire_wake_lock(lock);
-			else if (timeout > max_timeout)
-				max_timeout = timeout;
-		} else
-			return -1;
-	}
-	return max_timeout;
+	if (!nr_active[type])
+		return 0;
+	if (nr_untimed[type])
+		return -1;
+	timeout = max_expires[type] - jiffies;
+	return timeout > 0 ? timeout : 1;
 }
 
 extern unsigned char ftm_sleep;
@@ -301,8 +347,7 @@ long has_wake_lock(int type)
 		return 0;
 	spin_lock_irqsave(&list_lock, irqflags);
 	ret = has_wake_lock_locked(type);
-//	if (ret && (debug_mask & DEBUG_SUSPEND) && type == WAKE_LOCK_SUSPEND)
-	if (ret && type == WAKE_LOCK_SUSPEND)
+	if (ret && (debug_mask & DEBUG_SUSPEND) && type == WAKE_LOCK_SUSPEND)
 		print_active_locks(type);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 	return ret;
@@ -319,8 +364,8 @@ static void suspend(struct work_struct *work)
 		return;
 	}
 
+	/* pm_suspend() syncs the filesystems itself */
 	entry_event_num = current_event_num;
-	sys_sync();
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("suspend: enter suspend\n");
 	ret = pm_suspend(requested_suspend_state);
@@ -342,23 +387,28 @@ static void suspend(struct work_struct *work)
 }
 static DECLARE_WORK(suspend_work, suspend);
 
-static void expire_wake_locks(unsigned long data)
+static void expire_wake_lock_timer(unsigned long data)
 {
-	long has_lock;
+	struct wake_lock *lock = (struct wake_lock *)data;
 	unsigned long irqflags;
-	if (debug_mask & DEBUG_EXPIRE)
-		pr_info("expire_wake_locks: start\n");
+	int type;
+
 	spin_lock_irqsave(&list_lock, irqflags);
-	if (debug_mask & DEBUG_SUSPEND)
-		print_active_locks(WAKE_LOCK_SUSPEND);
-	has_lock = has_wake_lock_locked(WAKE_LOCK_SUSPEND);
-	if (debug_mask & DEBUG_EXPIRE)
-		pr_info("expire_wake_locks: done, has_lock %ld\n", has_lock);
-	if (has_lock == 0)
-		queue_work(suspend_work_queue, &suspend_work);
+	type = lock->flags & WAKE_LOCK_TYPE_MASK;
+	/* the lock may have been taken again since the timer fired */
+	if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
+	    (long)(lock->expires - jiffies) <= 0) {
+		expire_wake_lock(lock);
+		if (type == WAKE_LOCK_SUSPEND &&
+		    !has_wake_lock_locked(WAKE_LOCK_SUSPEND)) {
+			if (debug_mask & DEBUG_EXPIRE)
+				pr_info("expire_wake_lock_timer: %s was the "
+					"last wake lock\n", lock->name);
+			queue_work(suspend_work_queue, &suspend_work);
+		}
+	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
-static DEFINE_TIMER(expire_timer, expire_wake_locks, 0, 0);
 
 static int power_suspend_late(struct device *dev)
 {
@@ -399,10 +449,13 @@ void wake_lock_init(struct wake_lock *lock, int type, const char *name)
 	lock->stat.wakeup_count = 0;
 	lock->stat.total_time = ktime_set(0, 0);
 	lock->stat.prevent_suspend_time = ktime_set(0, 0);
+	lock->stat.prevent_suspend_start = ktime_set(0, 0);
 	lock->stat.max_time = ktime_set(0, 0);
 	lock->stat.last_time = ktime_set(0, 0);
+	memset(lock->stat.hist, 0, sizeof(lock->stat.hist));
 #endif
 	lock->flags = (type & WAKE_LOCK_TYPE_MASK) | WAKE_LOCK_INITIALIZED;
+	setup_timer(&lock->timer, expire_wake_lock_timer, (unsigned long)lock);
 
 	INIT_LIST_HEAD(&lock->link);
 	spin_lock_irqsave(&list_lock, irqflags);
@@ -414,12 +467,16 @@ EXPORT_SYMBOL(wake_lock_init);
 void wake_lock_destroy(struct wake_lock *lock)
 {
 	unsigned long irqflags;
+
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_lock_destroy name=%s\n", lock->name);
 	spin_lock_irqsave(&list_lock, irqflags);
+	deactivate_wake_lock(lock);
 	lock->flags &= ~WAKE_LOCK_INITIALIZED;
 #ifdef CONFIG_WAKELOCK_STAT
 	if (lock->stat.count) {
+		int i;
+
 		deleted_wake_locks.stat.count += lock->stat.count;
 		deleted_wake_locks.stat.expire_count += lock->stat.expire_count;
 		deleted_wake_locks.stat.total_time =
@@ -431,10 +488,13 @@ void wake_lock_destroy(struct wake_lock *lock)
 		deleted_wake_locks.stat.max_time =
 			ktime_add(deleted_wake_locks.stat.max_time,
 				  lock->stat.max_time);
+		for (i = 0; i < WAKE_LOCK_HIST_BUCKETS; i++)
+			deleted_wake_locks.stat.hist[i] += lock->stat.hist[i];
 	}
 #endif
 	list_del(&lock->link);
 	spin_unlock_irqrestore(&list_lock, irqflags);
+	del_timer_sync(&lock->timer);
 }
 EXPORT_SYMBOL(wake_lock_destroy);
 
@@ -443,7 +503,6 @@ static void wake_lock_internal(
 {
 	int type;
 	unsigned long irqflags;
-	long expire_in;
 
 	spin_lock_irqsave(&list_lock, irqflags);
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
@@ -464,11 +523,12 @@ static void wake_lock_internal(
 #endif
 	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
 		lock->flags |= WAKE_LOCK_ACTIVE;
+		nr_active[type]++;
 #ifdef CONFIG_WAKELOCK_STAT
 		lock->stat.last_time = ktime_get();
 #endif
-	}
-	list_del(&lock->link);
+	} else if (!(lock->flags & WAKE_LOCK_AUTO_EXPIRE))
+		nr_untimed[type]--;
 	if (has_timeout) {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d, timeout %ld.%03lu\n",
@@ -476,39 +536,30 @@ static void wake_lock_internal(
 				(timeout % HZ) * MSEC_PER_SEC / HZ);
 		lock->expires = jiffies + timeout;
 		lock->flags |= WAKE_LOCK_AUTO_EXPIRE;
-		list_add_tail(&lock->link, &active_wake_locks[type]);
+		mod_timer(&lock->timer, lock->expires);
+		if (nr_active[type] - nr_untimed[type] == 1 ||
+		    time_after(lock->expires, max_expires[type]))
+			max_expires[type] = lock->expires;
+		list_move_tail(&lock->link, &active_wake_locks[type]);
 	} else {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d\n", lock->name, type);
 		lock->expires = LONG_MAX;
+		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+			del_timer(&lock->timer);
 		lock->flags &= ~WAKE_LOCK_AUTO_EXPIRE;
-		list_add(&lock->link, &active_wake_locks[type]);
+		nr_untimed[type]++;
+		list_move(&lock->link, &active_wake_locks[type]);
 	}
+	trace_wake_lock(lock->name, type, has_timeout ? timeout : -1);
 	if (type == WAKE_LOCK_SUSPEND) {
 		current_event_num++;
 #ifdef CONFIG_WAKELOCK_STAT
 		if (lock == &main_wake_lock)
 			update_sleep_wait_stats_locked(1);
 		else if (!wake_lock_active(&main_wake_lock))
-			update_sleep_wait_stats_locked(0);
+			start_preventing_suspend_locked(lock, ktime_get());
 #endif
-		if (has_timeout)
-			expire_in = has_wake_lock_locked(type);
-		else
-			expire_in = -1;
-		if (expire_in > 0) {
-			if (debug_mask & DEBUG_EXPIRE)
-				pr_info("wake_lock: %s, start expire timer, "
-					"%ld\n", lock->name, expire_in);
-			mod_timer(&expire_timer, jiffies + expire_in);
-		} else {
-			if (del_timer(&expire_timer))
-				if (debug_mask & DEBUG_EXPIRE)
-					pr_info("wake_lock: %s, stop expire timer\n",
-						lock->name);
-			if (expire_in == 0)
-				queue_work(suspend_work_queue, &suspend_work);
-		}
 	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
@@ -536,24 +587,11 @@ void wake_unlock(struct wake_lock *lock)
 #endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_unlock: %s\n", lock->name);
-	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
-	list_del(&lock->link);
-	list_add(&lock->link, &inactive_locks);
+	deactivate_wake_lock(lock);
+	trace_wake_unlock(lock->name, type, 0);
 	if (type == WAKE_LOCK_SUSPEND) {
-		long has_lock = has_wake_lock_locked(type);
-		if (has_lock > 0) {
-			if (debug_mask & DEBUG_EXPIRE)
-				pr_info("wake_unlock: %s, start expire timer, "
-					"%ld\n", lock->name, has_lock);
-			mod_timer(&expire_timer, jiffies + has_lock);
-		} else {
-			if (del_timer(&expire_timer))
-				if (debug_mask & DEBUG_EXPIRE)
-					pr_info("wake_unlock: %s, stop expire "
-						"timer\n", lock->name);
-			if (has_lock == 0)
-				queue_work(suspend_work_queue, &suspend_work);
-		}
+		if (!has_wake_lock_locked(type))
+			queue_work(suspend_work_queue, &suspend_work);
 		if (lock == &main_wake_lock) {
 			//if (debug_mask & DEBUG_SUSPEND)
 			print_active_locks(WAKE_LOCK_SUSPEND);
@@ -39,6 +39,7 @@
 #include <linux/syslog.h>
 #include <linux/cpu.h>
 #include <linux/notifier.h>
+#include <linux/kthread.h>
 
 #include <asm/uaccess.h>
 
@@ -147,6 +148,12 @@ EXPORT_SYMBOL(console_set_on_cmdline);
 /* Flag: console code may call schedule() */
 static int console_may_schedule;
 
+/*
+ * Thread that calls the console drivers on behalf of printk() when
+ * console output is deferred, see vprintk().
+ */
+static struct task_struct *console_thread;
+
 #ifdef CONFIG_PRINTK
 
 static char __log_buf[__LOG_BUF_LEN];
@@ -652,6 +659,17 @@ static int printk_time = 0;
 #endif
 module_param_named(time, printk_time, bool, S_IRUGO | S_IWUSR);
 
+/*
+ * Writing to a serial console takes milliseconds, all of it with
+ * interrupts off in whichever context called printk().  With deferred
+ * console output printk() only stores the message and console_thread
+ * writes it out.  Oopses, panics, critical messages, callers with
+ * interrupts off and anything before the system is up are still
+ * written synchronously, see console_defer_ok().
+ */
+static int console_defer = 1;
+module_param_named(defer_console, console_defer, bool, S_IRUGO | S_IWUSR);
+
 /* Check if we have any console registered that can be called early in boot. */
 static int have_callable_console(void)
 {
@@ -755,6 +773,48 @@ static int acquire_console_semaphore_for_printk(unsigned int cpu)
 	spin_unlock(&logbuf_lock);
 	return retval;
 }
+
+/*
+ * Messages from KERN_CRIT up and anything logged with interrupts off
+ * are still written right away: the thread may never get to run after
+ * a hard lockup or a reset that is not an oops.
+ */
+static inline int console_defer_ok(int log_level, unsigned long flags)
+{
+	return console_defer && console_thread && !oops_in_progress &&
+	       system_state == SYSTEM_RUNNING && log_level > 2 &&
+	       !irqs_disabled_flags(flags);
+}
+
+static int console_thread_fn(void *unused)
+{
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (con_start == log_end || console_suspended)
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		acquire_console_sem();
+		release_console_sem();
+	}
+	return 0;
+}
+
+static int __init console_thread_init(void)
+{
+	struct task_struct *p;
+
+	p = kthread_run(console_thread_fn, NULL, "kconsole");
+	if (IS_ERR(p)) {
+		printk(KERN_ERR "printk: cannot start kconsole: %ld\n",
+		       PTR_ERR(p));
+		return PTR_ERR(p);
+	}
+	console_thread = p;
+	return 0;
+}
+core_initcall(console_thread_init);
+
 static const char recursion_bug_msg [] =
 		KERN_CRIT "BUG: recent printk recursion!\n";
 static int recursion_bug;
@@ -890,6 +950,16 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 			new_text_line = 1;
 	}
 
+	/*
+	 * Leave the consoles to console_thread if we can.
+	 */
+	if (console_defer_ok(current_log_level, flags)) {
+		printk_cpu = UINT_MAX;
+		spin_unlock(&logbuf_lock);
+		wake_up_process(console_thread);
+		goto out_lockdep;
+	}
+
 	/*
 	 * Try to acquire and then immediately release the
 	 * console semaphore. The release will do all the
@@ -903,6 +973,7 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 	if (acquire_console_semaphore_for_printk(this_cpu))
 		release_console_sem();
 
+out_lockdep:
 	lockdep_on();
 out_restore_irqs:
 	raw_local_irq_restore(flags);
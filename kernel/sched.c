@@ -84,6 +84,7 @@
 #include <linux/acct.h>
 #endif
 #include "sched_cpupri.h"
+#include "workqueue_sched.h"
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/sched.h>
@@ -274,6 +275,10 @@ struct task_group {
 	struct task_group *parent;
 	struct list_head siblings;
 	struct list_head children;
+
+#ifdef CONFIG_SCHED_AUTOGROUP
+	struct autogroup *autogroup;
+#endif
 };
 
 #define root_task_group init_task_group
@@ -315,6 +320,8 @@ struct task_group init_task_group;
 
 #endif	/* CONFIG_CGROUP_SCHED */
 
+#include "sched_autogroup.h"
+
 /* CFS-related fields in a runqueue */
 struct cfs_rq {
 	struct load_weight load;
@@ -523,6 +530,8 @@ struct rq {
 	u64 age_stamp;
 	u64 idle_stamp;
 	u64 avg_idle;
+	/* exit latency (us) of the idle state this cpu is in, see cpuidle */
+	unsigned int idle_exit_latency;
 #endif
 
 	/* calc_load related fields */
@@ -555,6 +564,12 @@ struct rq {
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
 
+	/* select_idle_sibling() stats */
+	unsigned int ttwu_idle_target;
+	unsigned int ttwu_idle_sibling;
+	unsigned int ttwu_idle_shallower;
+	unsigned int ttwu_busy;
+
 	/* BKL stats */
 	unsigned int bkl_count;
 #endif
@@ -617,11 +632,14 @@ static inline int cpu_of(struct rq *rq)
  */
 static inline struct task_group *task_group(struct task_struct *p)
 {
+	struct task_group *tg;
 	struct cgroup_subsys_state *css;
 
 	css = task_subsys_state_check(p, cpu_cgroup_subsys_id,
 			lockdep_is_held(&task_rq(p)->lock));
-	return container_of(css, struct task_group, css);
+	tg = container_of(css, struct task_group, css);
+
+	return autogroup_task_group(p, tg);
 }
 
 /* Change a task's cfs_rq and parent entity if it moves across CPUs/groups */
@@ -633,6 +651,15 @@ static inline void set_task_rq(struct task_struct *p, unsigned int cpu)
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
+	/*
+	 * Autogroups get no RT bandwidth, so their tasks go to the root
+	 * group's rt_rq and a policy change needs no move between groups.
+	 */
+	if (task_group_is_autogroup(task_group(p))) {
+		p->rt.rt_rq  = root_task_group.rt_rq[cpu];
+		p->rt.parent = root_task_group.rt_se[cpu];
+		return;
+	}
 	p->rt.rt_rq  = task_group(p)->rt_rq[cpu];
 	p->rt.parent = task_group(p)->rt_se[cpu];
 #endif
@@ -1899,6 +1926,7 @@ static void deactivate_task(struct rq *rq, struct task_struct *p, int flags)
 #include "sched_idletask.c"
 #include "sched_fair.c"
 #include "sched_rt.c"
+#include "sched_autogroup.c"
 #ifdef CONFIG_SCHED_DEBUG
 # include "sched_debug.c"
 #endif
@@ -2368,6 +2396,10 @@ out_activate:
 	activate_task(rq, p, en_flags);
 	success = 1;
 
+	/* a waking pool worker counts towards its pool's concurrency again */
+	if (p->flags & PF_WQ_WORKER)
+		wq_worker_waking_up(p, cpu_of(rq));
+
 out_running:
 	trace_sched_wakeup(p, success);
 	check_preempt_curr(rq, p, wake_flags);
@@ -2395,6 +2427,47 @@ out:
 	return success;
 }
 
+/**
+ * try_to_wake_up_local - try to wake up a local task with rq lock held
+ * @p: the thread to be awakened
+ *
+ * Put @p on the run-queue if it's not already there.  The caller must
+ * ensure that this_rq() is locked, @p is bound to this_rq() and not
+ * the current task.  this_rq() stays locked over invocation.
+ */
+static void try_to_wake_up_local(struct task_struct *p)
+{
+	struct rq *rq = task_rq(p);
+	int success = 0;
+
+	BUG_ON(rq != this_rq());
+	BUG_ON(p == current);
+	lockdep_assert_held(&rq->lock);
+
+	if (!(p->state & TASK_NORMAL))
+		return;
+
+	if (!p->se.on_rq) {
+		if (likely(!task_running(rq, p))) {
+			schedstat_inc(rq, ttwu_count);
+			schedstat_inc(rq, ttwu_local);
+		}
+		schedstat_inc(p, se.statistics.nr_wakeups);
+		schedstat_inc(p, se.statistics.nr_wakeups_local);
+		activate_task(rq, p, ENQUEUE_WAKEUP);
+		success = 1;
+	}
+
+	trace_sched_wakeup(p, success);
+	check_preempt_curr(rq, p, 0);
+
+	p->state = TASK_RUNNING;
+#ifdef CONFIG_SMP
+	if (p->sched_class->task_woken)
+		p->sched_class->task_woken(rq, p);
+#endif
+}
+
 /**
  * wake_up_process - Wake up a specific process
  * @p: The process to be woken up.
@@ -3589,6 +3662,14 @@ asmlinkage void __sched schedule(void)
 	struct rq *rq;
 	int cpu;
 
+	/*
+	 * If we are going to sleep and we have plugged IO queued, make
+	 * sure to submit it to avoid deadlocks.
+	 */
+	if (current->state && !(preempt_count() & PREEMPT_ACTIVE) &&
+	    blk_needs_flush_plug(current))
+		blk_schedule_flush_plug(current);
+
 need_resched:
 	preempt_disable();
 	cpu = smp_processor_id();
@@ -3609,10 +3690,23 @@ need_resched_nonpreemptible:
 	clear_tsk_need_resched(prev);
 
 	if (prev->state && !(preempt_count() & PREEMPT_ACTIVE)) {
-		if (unlikely(signal_pending_state(prev->state, prev)))
+		if (unlikely(signal_pending_state(prev->state, prev))) {
 			prev->state = TASK_RUNNING;
-		else
+		} else {
+			/*
+			 * If a pool worker is going to sleep, let the
+			 * workqueue code wake another worker to keep the
+			 * pool busy.
+			 */
+			if (prev->flags & PF_WQ_WORKER) {
+				struct task_struct *to_wakeup;
+
+				to_wakeup = wq_worker_sleeping(prev, cpu);
+				if (to_wakeup)
+					try_to_wake_up_local(to_wakeup);
+			}
 			deactivate_task(rq, prev, DEQUEUE_SLEEP);
+		}
 		switch_count = &prev->nvcsw;
 	}
 
@@ -4352,6 +4446,20 @@ int idle_cpu(int cpu)
 	return cpu_curr(cpu) == cpu_rq(cpu)->idle;
 }
 
+#ifdef CONFIG_SMP
+/**
+ * sched_idle_set_exit_latency - note how long this cpu takes to wake up
+ * @latency: exit latency in us of the idle state being entered, 0 on exit
+ *
+ * Called by cpuidle with interrupts disabled.  Wakeups prefer idle cpus
+ * in shallow states over those that would take long to come back.
+ */
+void sched_idle_set_exit_latency(unsigned int latency)
+{
+	this_rq()->idle_exit_latency = latency;
+}
+#endif
+
 /**
  * idle_task - return the idle task for a given cpu.
  * @cpu: the processor in question.
@@ -4503,7 +4611,8 @@ recheck:
 		 * assigned.
 		 */
 		if (rt_bandwidth_enabled() && rt_policy(policy) &&
-				task_group(p)->rt_bandwidth.rt_runtime == 0) {
+				task_group(p)->rt_bandwidth.rt_runtime == 0 &&
+				!task_group_is_autogroup(task_group(p))) {
 			__task_rq_unlock(rq);
 			raw_spin_unlock_irqrestore(&p->pi_lock, flags);
 			return -EPERM;
@@ -7563,6 +7672,7 @@ void __init sched_init(void)
 #ifdef CONFIG_CGROUP_SCHED
 	list_add(&init_task_group.list, &task_groups);
 	INIT_LIST_HEAD(&init_task_group.children);
+	autogroup_init(&init_task);
 
 #endif /* CONFIG_CGROUP_SCHED */
 
@@ -8024,6 +8134,7 @@ static void free_sched_group(struct task_group *tg)
 {
 	free_fair_sched_group(tg);
 	free_rt_sched_group(tg);
+	autogroup_free(tg);
 	kfree(tg);
 }
 
@@ -1387,6 +1387,67 @@ find_idlest_cpu(struct sched_group *group, struct task_struct *p, int this_cpu)
 	return idlest;
 }
 
+/*
+ * Find the idle cpu in the domain spanning this cpu and prev_cpu that
+ * would come back the quickest, as told by cpuidle through
+ * sched_idle_set_exit_latency().  Unlike the SD_SHARE_PKG_RESOURCES walk
+ * this works where cores do not share a cache level the scheduler knows
+ * of, such as the two Cortex-A9s of an OMAP4, which get no domain of
+ * that kind at all.
+ */
+static int select_idle_shallowest(struct task_struct *p, int target)
+{
+	int cpu = smp_processor_id();
+	int prev_cpu = task_cpu(p);
+	unsigned int latency, min_latency = UINT_MAX;
+	struct sched_domain *sd;
+	int i, best = -1;
+
+	for_each_domain(target, sd) {
+		if (cpumask_test_cpu(cpu, sched_domain_span(sd)) &&
+		    cpumask_test_cpu(prev_cpu, sched_domain_span(sd)))
+			break;
+	}
+
+	if (idle_cpu(target)) {
+		best = target;
+		min_latency = cpu_rq(target)->idle_exit_latency;
+	}
+
+	if (sd && min_latency) {
+		for_each_cpu_and(i, sched_domain_span(sd), &p->cpus_allowed) {
+			if (i == target || !idle_cpu(i))
+				continue;
+
+			/*
+			 * Ties keep an idle target; otherwise they go to
+			 * prev_cpu, whose cache may still be warm.
+			 */
+			latency = cpu_rq(i)->idle_exit_latency;
+			if (latency < min_latency ||
+			    (latency == min_latency && i == prev_cpu &&
+			     best != target)) {
+				min_latency = latency;
+				best = i;
+			}
+		}
+	}
+
+	if (best < 0) {
+		schedstat_inc(this_rq(), ttwu_busy);
+		return target;
+	}
+
+	if (best == target)
+		schedstat_inc(this_rq(), ttwu_idle_target);
+	else if (idle_cpu(target))
+		schedstat_inc(this_rq(), ttwu_idle_shallower);
+	else
+		schedstat_inc(this_rq(), ttwu_idle_sibling);
+
+	return best;
+}
+
 /*
  * Try and locate an idle CPU in the sched_domain.
  */
@@ -1394,6 +1455,7 @@ static int select_idle_sibling(struct task_struct *p, int target)
 {
 	int cpu = smp_processor_id();
 	int prev_cpu = task_cpu(p);
+	int orig_target = target;
 	struct sched_domain *sd;
 	int i;
 
@@ -1401,15 +1463,22 @@ static int select_idle_sibling(struct task_struct *p, int target)
 	 * If the task is going to be woken-up on this cpu and if it is
 	 * already idle, then it is the right target.
 	 */
-	if (target == cpu && idle_cpu(cpu))
+	if (target == cpu && idle_cpu(cpu)) {
+		schedstat_inc(this_rq(), ttwu_idle_target);
 		return cpu;
+	}
+
+	if (sched_feat(IDLE_EXIT_LATENCY))
+		return select_idle_shallowest(p, target);
 
 	/*
 	 * If the task is going to be woken-up on the cpu where it previously
 	 * ran and if it is currently idle, then it the right target.
 	 */
-	if (target == prev_cpu && idle_cpu(prev_cpu))
+	if (target == prev_cpu && idle_cpu(prev_cpu)) {
+		schedstat_inc(this_rq(), ttwu_idle_target);
 		return prev_cpu;
+	}
 
 	/*
 	 * Otherwise, iterate the domains and find an elegible idle cpu.
@@ -1434,6 +1503,11 @@ static int select_idle_sibling(struct task_struct *p, int target)
 			break;
 	}
 
+	if (target != orig_target)
+		schedstat_inc(this_rq(), ttwu_idle_sibling);
+	else
+		schedstat_inc(this_rq(), ttwu_busy);
+
 	return target;
 }
 
@@ -24,6 +24,13 @@ SCHED_FEAT(WAKEUP_PREEMPT, 1)
  */
 SCHED_FEAT(AFFINE_WAKEUPS, 1)
 
+/*
+ * Wake tasks up on the idle cpu that leaves its idle state the quickest,
+ * going by the exit latency cpuidle reports, instead of only searching
+ * among cpus sharing a cache.
+ */
+SCHED_FEAT(IDLE_EXIT_LATENCY, 1)
+
 /*
  * Prefer to schedule the task we woke last (assuming it failed
  * wakeup-preemption), since its likely going to consume data we
@@ -36,6 +36,73 @@
 #define CREATE_TRACE_POINTS
 #include <trace/events/workqueue.h>
 
+#include "workqueue_sched.h"
+
+/*
+ * Workqueues which are not freezeable, rt or needed by memory reclaim
+ * don't get threads of their own.  Their cpu_workqueue_structs are
+ * served by a pool of workers per cpu: a cwq with pending work and
+ * nobody serving it sits on its pool's ready list until a worker takes
+ * it.  A cwq is served by at most one worker at a time, so its work
+ * items run one after another in queueing order exactly as they do on
+ * a dedicated thread, and flushing works the same way.
+ *
+ * The pool counts its busy workers which are runnable.  When the last
+ * of them blocks, the scheduler wakes an idle worker to take the next
+ * ready cwq, so a work item that sleeps only holds up its own cwq.  One
+ * idle worker is kept in reserve for this; the worker which takes the
+ * reserve forks a replacement, and idle workers beyond the reserve exit
+ * after WORKER_IDLE_TIMEOUT.
+ *
+ * From CPU_DOWN_PREPARE on, the pool is disassociated from its cpu and
+ * the scheduler no longer tells it when a worker blocks.  Instead, a
+ * worker taking a cwq wakes another one for the cwqs still ready, and
+ * the spares forked meanwhile are not bound to the cpu.  If the cpu
+ * stays up after all, those unbound workers leave before the pool goes
+ * back to normal operation.
+ *
+ * Single threaded workqueues are served by the pool of singlethread_cpu,
+ * which is expected to stay online.
+ */
+enum {
+	POOL_DISASSOCIATED	= 1 << 0,	/* cpu going or gone */
+	POOL_CREATING		= 1 << 1,	/* forking a spare */
+	POOL_TEARDOWN		= 1 << 2,	/* workers must exit */
+	POOL_REBIND		= 1 << 3,	/* cpu stays, unbound must exit */
+
+	WORKER_IDLE		= 1 << 0,	/* not in nr_running */
+	WORKER_UNBOUND		= 1 << 1,	/* forked while disassociated */
+
+	WORKER_MIN_IDLE		= 1,		/* idle reserve */
+	WORKER_IDLE_TIMEOUT	= 300 * HZ,
+};
+
+struct worker_pool {
+	spinlock_t		lock;
+	unsigned int		cpu;
+	unsigned int		flags;		/* POOL_* */
+
+	struct list_head	ready;		/* cwqs needing a worker */
+	struct list_head	idle_list;	/* most recent first */
+	int			nr_workers;
+	int			nr_idle;
+	int			nr_unbound;
+	int			next_id;
+	atomic_t		nr_running;	/* busy and runnable */
+
+	struct worker		*unstarted;	/* from CPU_UP_PREPARE */
+	wait_queue_head_t	teardown_wait;
+};
+
+struct worker {
+	struct list_head	entry;		/* on pool->idle_list */
+	struct task_struct	*task;
+	struct worker_pool	*pool;
+	unsigned int		flags;		/* WORKER_*, only self */
+};
+
+static DEFINE_PER_CPU_SHARED_ALIGNED(struct worker_pool, worker_pools);
+
 /*
  * The per-CPU workqueue (if single thread, we always use the first
  * possible cpu).
@@ -50,6 +117,11 @@ struct cpu_workqueue_struct {
 
 	struct workqueue_struct *wq;
 	struct task_struct *thread;
+
+	/* cwqs of shared workqueues, pool->lock protects the rest */
+	struct worker_pool *pool;
+	struct worker *worker;		/* worker serving this cwq */
+	struct list_head ready_entry;	/* on pool->ready */
 } ____cacheline_aligned;
 
 /*
@@ -63,6 +135,7 @@ struct workqueue_struct {
 	int singlethread;
 	int freezeable;		/* Freeze threads during suspend */
 	int rt;
+	int reclaim;		/* Needed to make progress in reclaim */
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
@@ -199,6 +272,12 @@ static inline int is_wq_single_threaded(struct workqueue_struct *wq)
 	return wq->singlethread;
 }
 
+/* Whether the workqueue runs on the shared worker pools. */
+static inline int is_wq_shared(struct workqueue_struct *wq)
+{
+	return !wq->freezeable && !wq->rt && !wq->reclaim;
+}
+
 static const struct cpumask *wq_cpu_map(struct workqueue_struct *wq)
 {
 	return is_wq_single_threaded(wq)
@@ -245,10 +324,73 @@ struct cpu_workqueue_struct *get_wq_data(struct work_struct *work)
 	return (void *) (atomic_long_read(&work->data) & WORK_STRUCT_WQ_DATA_MASK);
 }
 
+/*
+ * The task running @cwq's work, if any.  The caller holds cwq->lock,
+ * which keeps a pool worker from letting go of @cwq.
+ */
+static struct task_struct *cwq_task(struct cpu_workqueue_struct *cwq)
+{
+	if (cwq->thread)
+		return cwq->thread;
+	return cwq->worker ? cwq->worker->task : NULL;
+}
+
+/* Is @cwq being run by the current task? */
+static int cwq_is_current(struct cpu_workqueue_struct *cwq)
+{
+	if (cwq->thread)
+		return cwq->thread == current;
+	return (current->flags & PF_WQ_WORKER) &&
+		ACCESS_ONCE(cwq->worker) == kthread_data(current);
+}
+
+static struct worker *first_idle_worker(struct worker_pool *pool)
+{
+	if (list_empty(&pool->idle_list))
+		return NULL;
+	return list_first_entry(&pool->idle_list, struct worker, entry);
+}
+
+static void wake_up_idle_worker(struct worker_pool *pool)
+{
+	struct worker *worker = first_idle_worker(pool);
+
+	if (likely(worker))
+		wake_up_process(worker->task);
+}
+
+/*
+ * Called with cwq->lock held after work was added to @cwq.  Unless a
+ * worker is serving @cwq already, put it on the ready list and make
+ * sure a worker is going to look at it.
+ */
+static void pool_cwq_ready(struct cpu_workqueue_struct *cwq)
+{
+	struct worker_pool *pool = cwq->pool;
+
+	spin_lock(&pool->lock);
+	if (!cwq->worker && list_empty(&cwq->ready_entry)) {
+		list_add_tail(&cwq->ready_entry, &pool->ready);
+		/*
+		 * Pairs with atomic_dec_and_test() in wq_worker_sleeping():
+		 * either the last worker going to sleep sees @cwq on the
+		 * ready list, or we see nr_running at zero.
+		 */
+		smp_mb();
+		if (!atomic_read(&pool->nr_running) ||
+		    (pool->flags & POOL_DISASSOCIATED))
+			wake_up_idle_worker(pool);
+	}
+	spin_unlock(&pool->lock);
+}
+
 static void insert_work(struct cpu_workqueue_struct *cwq,
 			struct work_struct *work, struct list_head *head)
 {
-	trace_workqueue_insertion(cwq->thread, work);
+	struct task_struct *task = cwq_task(cwq);
+
+	if (task)
+		trace_workqueue_insertion(task, work);
 
 	set_wq_data(work, cwq);
 	/*
@@ -257,7 +399,10 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 	 */
 	smp_wmb();
 	list_add_tail(&work->entry, head);
-	wake_up(&cwq->more_work);
+	if (cwq->pool)
+		pool_cwq_ready(cwq);
+	else
+		wake_up(&cwq->more_work);
 }
 
 static void __queue_work(struct cpu_workqueue_struct *cwq,
@@ -382,52 +527,60 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 }
 EXPORT_SYMBOL_GPL(queue_delayed_work_on);
 
-static void run_workqueue(struct cpu_workqueue_struct *cwq)
+/*
+ * Run the first work item on @cwq.  Called and returns with cwq->lock
+ * held and interrupts disabled; drops them while the item runs.
+ */
+static void process_one_work(struct cpu_workqueue_struct *cwq)
 {
-	spin_lock_irq(&cwq->lock);
-	while (!list_empty(&cwq->worklist)) {
-		struct work_struct *work = list_entry(cwq->worklist.next,
-						struct work_struct, entry);
-		work_func_t f = work->func;
+	struct work_struct *work = list_entry(cwq->worklist.next,
+					struct work_struct, entry);
+	work_func_t f = work->func;
 #ifdef CONFIG_LOCKDEP
-		/*
-		 * It is permissible to free the struct work_struct
-		 * from inside the function that is called from it,
-		 * this we need to take into account for lockdep too.
-		 * To avoid bogus "held lock freed" warnings as well
-		 * as problems when looking into work->lockdep_map,
-		 * make a copy and use that here.
-		 */
-		struct lockdep_map lockdep_map = work->lockdep_map;
+	/*
+	 * It is permissible to free the struct work_struct
+	 * from inside the function that is called from it,
+	 * this we need to take into account for lockdep too.
+	 * To avoid bogus "held lock freed" warnings as well
+	 * as problems when looking into work->lockdep_map,
+	 * make a copy and use that here.
+	 */
+	struct lockdep_map lockdep_map = work->lockdep_map;
 #endif
-		trace_workqueue_execution(cwq->thread, work);
-		debug_work_deactivate(work);
-		cwq->current_work = work;
-		list_del_init(cwq->worklist.next);
-		spin_unlock_irq(&cwq->lock);
-
-		BUG_ON(get_wq_data(work) != cwq);
-		work_clear_pending(work);
-		lock_map_acquire(&cwq->wq->lockdep_map);
-		lock_map_acquire(&lockdep_map);
-		f(work);
-		lock_map_release(&lockdep_map);
-		lock_map_release(&cwq->wq->lockdep_map);
-
-		if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
-			printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
-					"%s/0x%08x/%d\n",
-					current->comm, preempt_count(),
-				       	task_pid_nr(current));
-			printk(KERN_ERR "    last function: ");
-			print_symbol("%s\n", (unsigned long)f);
-			debug_show_held_locks(current);
-			dump_stack();
-		}
+	trace_workqueue_execution(current, work);
+	debug_work_deactivate(work);
+	cwq->current_work = work;
+	list_del_init(cwq->worklist.next);
+	spin_unlock_irq(&cwq->lock);
 
-		spin_lock_irq(&cwq->lock);
-		cwq->current_work = NULL;
+	BUG_ON(get_wq_data(work) != cwq);
+	work_clear_pending(work);
+	lock_map_acquire(&cwq->wq->lockdep_map);
+	lock_map_acquire(&lockdep_map);
+	f(work);
+	lock_map_release(&lockdep_map);
+	lock_map_release(&cwq->wq->lockdep_map);
+
+	if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
+		printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
+				"%s/0x%08x/%d\n",
+				current->comm, preempt_count(),
+			       	task_pid_nr(current));
+		printk(KERN_ERR "    last function: ");
+		print_symbol("%s\n", (unsigned long)f);
+		debug_show_held_locks(current);
+		dump_stack();
 	}
+
+	spin_lock_irq(&cwq->lock);
+	cwq->current_work = NULL;
+}
+
+static void run_workqueue(struct cpu_workqueue_struct *cwq)
+{
+	spin_lock_irq(&cwq->lock);
+	while (!list_empty(&cwq->worklist))
+		process_one_work(cwq);
 	spin_unlock_irq(&cwq->lock);
 }
 
@@ -458,6 +611,286 @@ static int worker_thread(void *__cwq)
 	return 0;
 }
 
+/**
+ * wq_worker_waking_up - a worker is waking up
+ * @task: task waking up
+ * @cpu: CPU @task is waking up to
+ *
+ * Called from try_to_wake_up() with the rq lock held when a pool
+ * worker is put back on a runqueue.
+ */
+void wq_worker_waking_up(struct task_struct *task, unsigned int cpu)
+{
+	struct worker *worker = kthread_data(task);
+	struct worker_pool *pool = worker->pool;
+
+	if (!(worker->flags & WORKER_IDLE)) {
+		WARN_ON_ONCE(cpu != pool->cpu &&
+			     !(pool->flags & POOL_DISASSOCIATED));
+		atomic_inc(&pool->nr_running);
+	}
+}
+
+/**
+ * wq_worker_sleeping - a worker is going to sleep
+ * @task: task going to sleep
+ * @cpu: CPU in question, must be the current CPU number
+ *
+ * Called from schedule() with the rq lock held when a busy pool worker
+ * blocks.  Returns the idle worker to wake up on this cpu if @task was
+ * the last runnable one and there are cwqs waiting, NULL otherwise.
+ */
+struct task_struct *wq_worker_sleeping(struct task_struct *task,
+				       unsigned int cpu)
+{
+	struct worker *worker = kthread_data(task);
+	struct worker_pool *pool = worker->pool;
+	struct worker *to_wakeup;
+
+	if (worker->flags & WORKER_IDLE)
+		return NULL;
+
+	/*
+	 * While the pool is associated with its cpu, only workers bound
+	 * to that cpu take themselves off the idle list, and none of them
+	 * can run while we hold the rq lock, so the list can be looked at
+	 * without pool->lock.
+	 */
+	if (atomic_dec_and_test(&pool->nr_running) &&
+	    !list_empty(&pool->ready) &&
+	    !(pool->flags & POOL_DISASSOCIATED)) {
+		WARN_ON_ONCE(cpu != pool->cpu);
+		to_wakeup = first_idle_worker(pool);
+		if (to_wakeup)
+			return to_wakeup->task;
+	}
+	return NULL;
+}
+
+static int pool_worker_thread(void *__worker);
+
+/*
+ * Fork a new worker for @pool.  It starts out idle and is neither bound
+ * nor woken up, see start_worker().
+ */
+static struct worker *create_worker(struct worker_pool *pool)
+{
+	struct worker *worker;
+	int id;
+
+	worker = kzalloc(sizeof(*worker), GFP_KERNEL);
+	if (!worker)
+		return NULL;
+
+	INIT_LIST_HEAD(&worker->entry);
+	worker->pool = pool;
+	worker->flags = WORKER_IDLE;
+
+	spin_lock_irq(&pool->lock);
+	id = pool->next_id++;
+	spin_unlock_irq(&pool->lock);
+
+	worker->task = kthread_create(pool_worker_thread, worker,
+				      "kworker/%u:%d", pool->cpu, id);
+	if (IS_ERR(worker->task)) {
+		kfree(worker);
+		return NULL;
+	}
+
+	spin_lock_irq(&pool->lock);
+	pool->nr_workers++;
+	spin_unlock_irq(&pool->lock);
+
+	trace_workqueue_creation(worker->task, pool->cpu);
+	return worker;
+}
+
+static void start_worker(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	spin_lock_irq(&pool->lock);
+	if ((pool->flags & (POOL_DISASSOCIATED | POOL_REBIND)) ==
+	    POOL_DISASSOCIATED) {
+		worker->flags |= WORKER_UNBOUND;
+		pool->nr_unbound++;
+	}
+	spin_unlock_irq(&pool->lock);
+
+	if (!(worker->flags & WORKER_UNBOUND))
+		kthread_bind(worker->task, pool->cpu);
+	wake_up_process(worker->task);
+}
+
+/* Get rid of a worker which create_worker() made but nobody started. */
+static void destroy_unstarted_worker(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	trace_workqueue_destruction(worker->task);
+	kthread_stop(worker->task);
+
+	spin_lock_irq(&pool->lock);
+	pool->nr_workers--;
+	spin_unlock_irq(&pool->lock);
+	kfree(worker);
+}
+
+/*
+ * Park @worker on the idle list until a cwq becomes ready.  Called and
+ * returns with pool->lock held.  Returns 0 if the worker should exit.
+ */
+static int worker_idle(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+	long timeout;
+
+	if (!(worker->flags & WORKER_IDLE)) {
+		worker->flags |= WORKER_IDLE;
+		atomic_dec(&pool->nr_running);
+	}
+	if (list_empty(&worker->entry)) {
+		list_add(&worker->entry, &pool->idle_list);
+		pool->nr_idle++;
+	}
+
+	if (pool->flags & POOL_TEARDOWN)
+		return 0;
+
+	__set_current_state(TASK_INTERRUPTIBLE);
+	spin_unlock_irq(&pool->lock);
+	timeout = schedule_timeout(WORKER_IDLE_TIMEOUT);
+	spin_lock_irq(&pool->lock);
+
+	/* stay if woken up for work or needed as the reserve */
+	return timeout || !list_empty(&pool->ready) ||
+		pool->nr_idle <= WORKER_MIN_IDLE;
+}
+
+static void worker_leave_idle(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	worker->flags &= ~WORKER_IDLE;
+	atomic_inc(&pool->nr_running);
+	if (!list_empty(&worker->entry)) {
+		list_del_init(&worker->entry);
+		pool->nr_idle--;
+	}
+}
+
+/*
+ * Run the work on @cwq until it is empty, or until it has run an item
+ * and another cwq is waiting.  @cwq is then handed back to the pool,
+ * at the end of the ready list if it still has work.
+ */
+static void process_cwq(struct worker *worker,
+			struct cpu_workqueue_struct *cwq)
+{
+	struct worker_pool *pool = worker->pool;
+
+	spin_lock_irq(&cwq->lock);
+	while (!list_empty(&cwq->worklist)) {
+		process_one_work(cwq);
+		if (!list_empty(&pool->ready))
+			break;
+	}
+
+	spin_lock(&pool->lock);
+	cwq->worker = NULL;
+	if (!list_empty(&cwq->worklist))
+		list_add_tail(&cwq->ready_entry, &pool->ready);
+	spin_unlock(&pool->lock);
+
+	/* see wait_cwq_released() */
+	if (waitqueue_active(&cwq->more_work))
+		wake_up(&cwq->more_work);
+	spin_unlock_irq(&cwq->lock);
+}
+
+static int pool_worker_thread(void *__worker)
+{
+	struct worker *worker = __worker;
+	struct worker_pool *pool = worker->pool;
+	struct cpu_workqueue_struct *cwq;
+	struct worker *spare;
+
+	current->flags |= PF_WQ_WORKER;
+
+	spin_lock_irq(&pool->lock);
+	for (;;) {
+		if ((worker->flags & WORKER_UNBOUND) &&
+		    (pool->flags & POOL_REBIND))
+			break;
+
+		if (list_empty(&pool->ready)) {
+			if (!worker_idle(worker))
+				break;
+			continue;
+		}
+
+		if (worker->flags & WORKER_IDLE)
+			worker_leave_idle(worker);
+
+		/* we may be about to block, keep a worker in reserve */
+		if (!pool->nr_idle && !(pool->flags & POOL_CREATING)) {
+			pool->flags |= POOL_CREATING;
+			spin_unlock_irq(&pool->lock);
+
+			spare = create_worker(pool);
+			if (spare)
+				start_worker(spare);
+
+			spin_lock_irq(&pool->lock);
+			pool->flags &= ~POOL_CREATING;
+			if (list_empty(&pool->ready))
+				continue;
+		}
+
+		cwq = list_first_entry(&pool->ready,
+				struct cpu_workqueue_struct, ready_entry);
+		list_del_init(&cwq->ready_entry);
+		cwq->worker = worker;
+
+		/*
+		 * Nobody wakes a worker when this one blocks while the pool
+		 * is disassociated, so hand the other ready cwqs over now.
+		 */
+		if ((pool->flags & POOL_DISASSOCIATED) &&
+		    !list_empty(&pool->ready))
+			wake_up_idle_worker(pool);
+		spin_unlock_irq(&pool->lock);
+
+		process_cwq(worker, cwq);
+
+		spin_lock_irq(&pool->lock);
+	}
+
+	if (worker->flags & WORKER_IDLE) {
+		list_del_init(&worker->entry);
+		pool->nr_idle--;
+	} else
+		atomic_dec(&pool->nr_running);
+
+	if (worker->flags & WORKER_UNBOUND) {
+		/* the last unbound worker gives the pool back to its cpu */
+		if (!--pool->nr_unbound && (pool->flags & POOL_REBIND))
+			pool->flags &= ~(POOL_DISASSOCIATED | POOL_REBIND);
+		if (!list_empty(&pool->ready))
+			wake_up_idle_worker(pool);
+	}
+
+	if (!--pool->nr_workers)
+		wake_up(&pool->teardown_wait);
+	spin_unlock_irq(&pool->lock);
+
+	trace_workqueue_destruction(current);
+	current->flags &= ~PF_WQ_WORKER;
+	kfree(worker);
+
+	return 0;
+}
+
 struct wq_barrier {
 	struct work_struct	work;
 	struct completion	done;
@@ -492,7 +925,7 @@ static int flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
 	int active = 0;
 	struct wq_barrier barr;
 
-	WARN_ON(cwq->thread == current);
+	WARN_ON(cwq_is_current(cwq));
 
 	spin_lock_irq(&cwq->lock);
 	if (!list_empty(&cwq->worklist) || cwq->current_work != NULL) {
@@ -925,7 +1358,7 @@ int current_is_keventd(void)
 	BUG_ON(!keventd_wq);
 
 	cwq = per_cpu_ptr(keventd_wq->cpu_wq, cpu);
-	if (current == cwq->thread)
+	if (cwq_is_current(cwq))
 		ret = 1;
 
 	return ret;
@@ -941,6 +1374,9 @@ init_cpu_workqueue(struct workqueue_struct *wq, int cpu)
 	spin_lock_init(&cwq->lock);
 	INIT_LIST_HEAD(&cwq->worklist);
 	init_waitqueue_head(&cwq->more_work);
+	INIT_LIST_HEAD(&cwq->ready_entry);
+	if (is_wq_shared(wq))
+		cwq->pool = &per_cpu(worker_pools, cpu);
 
 	return cwq;
 }
@@ -952,6 +1388,10 @@ static int create_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
 	const char *fmt = is_wq_single_threaded(wq) ? "%s" : "%s/%d";
 	struct task_struct *p;
 
+	/* served by the worker pool */
+	if (cwq->pool)
+		return 0;
+
 	p = kthread_create(worker_thread, cwq, fmt, wq->name, cpu);
 	/*
 	 * Nobody can add the work_struct to this cwq,
@@ -987,6 +1427,7 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 						int singlethread,
 						int freezeable,
 						int rt,
+						int reclaim,
 						struct lock_class_key *key,
 						const char *lock_name)
 {
@@ -1009,6 +1450,7 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 	wq->singlethread = singlethread;
 	wq->freezeable = freezeable;
 	wq->rt = rt;
+	wq->reclaim = reclaim;
 	INIT_LIST_HEAD(&wq->list);
 
 	if (singlethread) {
@@ -1050,19 +1492,46 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 }
 EXPORT_SYMBOL_GPL(__create_workqueue_key);
 
+static int cwq_released(struct cpu_workqueue_struct *cwq)
+{
+	struct worker_pool *pool = cwq->pool;
+	int busy;
+
+	spin_lock_irq(&pool->lock);
+	busy = cwq->worker || !list_empty(&cwq->ready_entry);
+	spin_unlock_irq(&pool->lock);
+
+	return !busy;
+}
+
+/*
+ * The barrier flush_cpu_workqueue() waits for completes while the pool
+ * worker is still looking at @cwq; wait until it lets go.  Pool cwqs
+ * have no thread waiting on ->more_work, process_cwq() uses it to
+ * signal the release.
+ */
+static void wait_cwq_released(struct cpu_workqueue_struct *cwq)
+{
+	wait_event(cwq->more_work, cwq_released(cwq));
+}
+
 static void cleanup_workqueue_thread(struct cpu_workqueue_struct *cwq)
 {
 	/*
 	 * Our caller is either destroy_workqueue() or CPU_POST_DEAD,
 	 * cpu_add_remove_lock protects cwq->thread.
 	 */
-	if (cwq->thread == NULL)
+	if (cwq->thread == NULL && cwq->pool == NULL)
 		return;
 
 	lock_map_acquire(&cwq->wq->lockdep_map);
 	lock_map_release(&cwq->wq->lockdep_map);
 
 	flush_cpu_workqueue(cwq);
+	if (cwq->pool) {
+		wait_cwq_released(cwq);
+		return;
+	}
 	/*
 	 * If the caller is CPU_POST_DEAD and cwq->worklist was not empty,
 	 * a concurrent flush_workqueue() can insert a barrier after us.
@@ -1103,11 +1572,99 @@ void destroy_workqueue(struct workqueue_struct *wq)
 }
 EXPORT_SYMBOL_GPL(destroy_workqueue);
 
+static void __init init_worker_pool(struct worker_pool *pool,
+				    unsigned int cpu)
+{
+	spin_lock_init(&pool->lock);
+	pool->cpu = cpu;
+	pool->flags = POOL_DISASSOCIATED;
+	INIT_LIST_HEAD(&pool->ready);
+	INIT_LIST_HEAD(&pool->idle_list);
+	atomic_set(&pool->nr_running, 0);
+	init_waitqueue_head(&pool->teardown_wait);
+}
+
+/* CPU_UP_PREPARE: make the first worker, started at CPU_ONLINE. */
+static int worker_pool_prepare(struct worker_pool *pool)
+{
+	spin_lock_irq(&pool->lock);
+	pool->flags &= ~(POOL_DISASSOCIATED | POOL_TEARDOWN | POOL_REBIND);
+	spin_unlock_irq(&pool->lock);
+
+	pool->unstarted = create_worker(pool);
+	return pool->unstarted ? 0 : -ENOMEM;
+}
+
+static void worker_pool_start(struct worker_pool *pool)
+{
+	if (pool->unstarted) {
+		start_worker(pool->unstarted);
+		pool->unstarted = NULL;
+	}
+}
+
+static void worker_pool_disassociate(struct worker_pool *pool)
+{
+	spin_lock_irq(&pool->lock);
+	pool->flags |= POOL_DISASSOCIATED;
+	pool->flags &= ~POOL_REBIND;
+	/* the busy workers may block without anybody noticing from now on */
+	if (!list_empty(&pool->ready))
+		wake_up_idle_worker(pool);
+	spin_unlock_irq(&pool->lock);
+}
+
+/*
+ * CPU_DOWN_FAILED: the pool is associated again once the workers forked
+ * meanwhile, which can run anywhere, are gone.
+ */
+static void worker_pool_reassociate(struct worker_pool *pool)
+{
+	struct worker *worker;
+
+	spin_lock_irq(&pool->lock);
+	if (pool->nr_unbound) {
+		pool->flags |= POOL_REBIND;
+		list_for_each_entry(worker, &pool->idle_list, entry)
+			wake_up_process(worker->task);
+	} else
+		pool->flags &= ~POOL_DISASSOCIATED;
+	spin_unlock_irq(&pool->lock);
+}
+
+static void worker_pool_cancel(struct worker_pool *pool)
+{
+	if (pool->unstarted) {
+		destroy_unstarted_worker(pool->unstarted);
+		pool->unstarted = NULL;
+	}
+	worker_pool_disassociate(pool);
+}
+
+/*
+ * CPU_POST_DEAD: the cwqs of the dead cpu have been flushed, let the
+ * workers exit.  They no longer run on the dead cpu, so a fresh set
+ * is created by CPU_UP_PREPARE.
+ */
+static void worker_pool_teardown(struct worker_pool *pool)
+{
+	struct worker *worker;
+
+	spin_lock_irq(&pool->lock);
+	pool->flags |= POOL_TEARDOWN;
+	list_for_each_entry(worker, &pool->idle_list, entry)
+		wake_up_process(worker->task);
+	spin_unlock_irq(&pool->lock);
+
+	wait_event(pool->teardown_wait, !ACCESS_ONCE(pool->nr_workers));
+}
+
 static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 						unsigned long action,
 						void *hcpu)
 {
 	unsigned int cpu = (unsigned long)hcpu;
+	struct worker_pool *pool = &per_cpu(worker_pools, cpu);
 	struct cpu_workqueue_struct *cwq;
 	struct workqueue_struct *wq;
 	int err = 0;
@@ -1117,6 +1674,20 @@ static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 	switch (action) {
 	case CPU_UP_PREPARE:
 		cpumask_set_cpu(cpu, cpu_populated_map);
+		if (worker_pool_prepare(pool)) {
+			printk(KERN_ERR "workqueue pool for %i failed\n", cpu);
+			action = CPU_UP_CANCELED;
+			err = -ENOMEM;
+		}
+		break;
+
+	case CPU_DOWN_PREPARE:
+		worker_pool_disassociate(pool);
+		break;
+
+	case CPU_DOWN_FAILED:
+		worker_pool_reassociate(pool);
+		break;
 	}
 undo:
 	list_for_each_entry(wq, &workqueues, list) {
@@ -1138,6 +1709,8 @@ undo:
 			break;
 
 		case CPU_UP_CANCELED:
+			if (cwq->pool)
+				break;
 			start_workqueue_thread(cwq, -1);
 		case CPU_POST_DEAD:
 			cleanup_workqueue_thread(cwq);
@@ -1146,9 +1719,19 @@ undo:
 	}
 
 	switch (action) {
+	case CPU_ONLINE:
+		worker_pool_start(pool);
+		break;
+
 	case CPU_UP_CANCELED:
+		worker_pool_cancel(pool);
+		cpumask_clear_cpu(cpu, cpu_populated_map);
+		break;
+
 	case CPU_POST_DEAD:
+		worker_pool_teardown(pool);
 		cpumask_clear_cpu(cpu, cpu_populated_map);
+		break;
 	}
 
 	return notifier_from_errno(err);
@@ -1203,11 +1786,24 @@ EXPORT_SYMBOL_GPL(work_on_cpu);
 
 void __init init_workqueues(void)
 {
+	int cpu;
+
 	alloc_cpumask_var(&cpu_populated_map, GFP_KERNEL);
 
 	cpumask_copy(cpu_populated_map, cpu_online_mask);
 	singlethread_cpu = cpumask_first(cpu_possible_mask);
 	cpu_singlethread_map = cpumask_of(singlethread_cpu);
+
+	for_each_possible_cpu(cpu)
+		init_worker_pool(&per_cpu(worker_pools, cpu), cpu);
+	for_each_online_cpu(cpu) {
+		struct worker_pool *pool = &per_cpu(worker_pools, cpu);
+		int err = worker_pool_prepare(pool);
+
+		BUG_ON(err);
+		worker_pool_start(pool);
+	}
+
 	hotcpu_notifier(workqueue_cpu_callback, 0);
 	keventd_wq = create_workqueue("events");
 	BUG_ON(!keventd_wq);
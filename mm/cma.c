@@ -0,0 +1,416 @@
+/*
+ * Contiguous Memory Allocator
+ *
+ * Areas are reserved from bootmem, then handed to the buddy allocator as
+ * MIGRATE_CMA pageblocks, which only movable allocations fall back to.
+ * cma_alloc() picks a free stretch of the area out of a bitmap and asks
+ * alloc_contig_range() to migrate whatever the page allocator has put
+ * there out of the way.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/bootmem.h>
+#include <linux/bitmap.h>
+#include <linux/pfn.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/hrtimer.h>
+#include <linux/debugfs.h>
+#include <linux/cma.h>
+
+#define MAX_CMA_AREAS	8
+
+struct cma {
+	unsigned long	base_pfn;
+	unsigned long	count;		/* pages in the area */
+	unsigned long	*bitmap;	/* one bit per allocated page */
+	struct mutex	lock;		/* protects bitmap */
+	const char	*name;
+
+	u32		nr_allocs;
+	u32		nr_fails;
+	u32		nr_busy;	/* ranges given up on, then retried */
+	u64		last_alloc_us;
+	u64		max_alloc_us;
+	u64		total_alloc_us;
+};
+
+static struct cma cma_areas[MAX_CMA_AREAS];
+static unsigned cma_area_count;
+
+/* alloc_contig_range() callers must not isolate the same MAX_ORDER block */
+static DEFINE_MUTEX(cma_mutex);
+
+static phys_addr_t cma_default_size __initdata;
+static phys_addr_t cma_default_base __initdata;
+
+/*
+ * cma=size[@base]
+ */
+static int __init early_cma(char *p)
+{
+	cma_default_size = memparse(p, &p);
+	if (*p == '@')
+		cma_default_base = memparse(p + 1, &p);
+	return 0;
+}
+early_param("cma", early_cma);
+
+static unsigned long cma_alignment(void)
+{
+	return max_t(unsigned long, MAX_ORDER_NR_PAGES,
+		     pageblock_nr_pages) << PAGE_SHIFT;
+}
+
+/**
+ * cma_declare_contiguous - reserve a contiguous memory area
+ * @base: physical base of the area, or 0 to let bootmem place it
+ * @size: size of the area
+ * @name: name of the area, for cma_find() and debugfs
+ * @res_cma: where to store the area, may be NULL
+ *
+ * Must be called once bootmem is up but before it is torn down, which on
+ * ARM means from the machine's map_io callback.  @base and @size are
+ * rounded to the largest of MAX_ORDER and pageblock sizes.
+ */
+int __init cma_declare_contiguous(phys_addr_t base, phys_addr_t size,
+				  const char *name, struct cma **res_cma)
+{
+	unsigned long alignment = cma_alignment();
+	struct cma *cma;
+
+	if (cma_area_count == ARRAY_SIZE(cma_areas)) {
+		pr_err("cma: too many areas, %s not reserved\n", name);
+		return -ENOSPC;
+	}
+	if (!size)
+		return -EINVAL;
+
+	size = ALIGN(size, alignment);
+	if (base) {
+		base = ALIGN(base, alignment);
+		if (reserve_bootmem(base, size, BOOTMEM_EXCLUSIVE)) {
+			pr_err("cma: failed to reserve %lu MiB at 0x%08lx "
+			       "for %s\n", (unsigned long)size >> 20,
+			       (unsigned long)base, name);
+			return -EBUSY;
+		}
+	} else {
+		void *addr = __alloc_bootmem_nopanic(size, alignment, 0);
+
+		if (!addr) {
+			pr_err("cma: failed to allocate %lu MiB for %s\n",
+			       (unsigned long)size >> 20, name);
+			return -ENOMEM;
+		}
+		base = __pa(addr);
+	}
+
+	cma = &cma_areas[cma_area_count++];
+	cma->base_pfn = PFN_DOWN(base);
+	cma->count = size >> PAGE_SHIFT;
+	cma->name = name;
+	mutex_init(&cma->lock);
+	if (res_cma)
+		*res_cma = cma;
+
+	pr_info("cma: reserved %lu MiB at 0x%08lx for %s\n",
+		(unsigned long)size >> 20, (unsigned long)base, name);
+	return 0;
+}
+
+/**
+ * cma_reserve_default - reserve the area sized by the "cma=" parameter
+ */
+void __init cma_reserve_default(void)
+{
+	if (cma_default_size)
+		cma_declare_contiguous(cma_default_base, cma_default_size,
+				       "default", NULL);
+}
+
+static int __init cma_activate_area(struct cma *cma)
+{
+	unsigned long pfn = cma->base_pfn;
+	unsigned long end_pfn = pfn + cma->count;
+	struct zone *zone = page_zone(pfn_to_page(pfn));
+	unsigned long i;
+
+	for (i = pfn; i < end_pfn; i++) {
+		if (!pfn_valid(i) || page_zone(pfn_to_page(i)) != zone) {
+			pr_err("cma: %s spans a hole or several zones\n",
+			       cma->name);
+			return -EINVAL;
+		}
+	}
+
+	cma->bitmap = kzalloc(BITS_TO_LONGS(cma->count) * sizeof(long),
+			      GFP_KERNEL);
+	if (!cma->bitmap)
+		return -ENOMEM;
+
+	for (; pfn < end_pfn; pfn += pageblock_nr_pages)
+		init_cma_reserved_pageblock(pfn_to_page(pfn));
+
+	return 0;
+}
+
+static int __init cma_init_reserved_areas(void)
+{
+	unsigned i;
+
+	for (i = 0; i < cma_area_count; i++) {
+		struct cma *cma = &cma_areas[i];
+
+		/* a failed area stays reserved and hands out nothing */
+		if (cma_activate_area(cma))
+			cma->count = 0;
+	}
+
+	return 0;
+}
+core_initcall(cma_init_reserved_areas);
+
+/**
+ * cma_find - look up an area by name
+ * @name: name given to cma_declare_contiguous()
+ */
+struct cma *cma_find(const char *name)
+{
+	unsigned i;
+
+	for (i = 0; i < cma_area_count; i++)
+		if (!strcmp(cma_areas[i].name, name))
+			return &cma_areas[i];
+	return NULL;
+}
+EXPORT_SYMBOL(cma_find);
+
+/**
+ * cma_alloc - allocate physically contiguous pages from an area
+ * @cma: area to allocate from
+ * @count: number of pages
+ * @align: alignment of the first page, as an order
+ *
+ * May sleep, possibly for a long time while pages are migrated.  Returns
+ * the first of @count pages, each holding a reference, or NULL.
+ */
+struct page *cma_alloc(struct cma *cma, unsigned long count,
+		       unsigned int align)
+{
+	unsigned long mask, start = 0, bitmap_no, pfn;
+	struct page *page = NULL;
+	ktime_t t0;
+	u64 us;
+	int ret;
+
+	if (!cma || !cma->count || !count)
+		return NULL;
+
+	if (align > MAX_ORDER - 1)
+		align = MAX_ORDER - 1;
+	mask = (1UL << align) - 1;
+
+	t0 = ktime_get();
+	for (;;) {
+		mutex_lock(&cma->lock);
+		bitmap_no = bitmap_find_next_zero_area(cma->bitmap,
+					cma->count, start, count, mask);
+		if (bitmap_no >= cma->count) {
+			mutex_unlock(&cma->lock);
+			break;
+		}
+		bitmap_set(cma->bitmap, bitmap_no, count);
+		mutex_unlock(&cma->lock);
+
+		pfn = cma->base_pfn + bitmap_no;
+		mutex_lock(&cma_mutex);
+		ret = alloc_contig_range(pfn, pfn + count, MIGRATE_CMA);
+		mutex_unlock(&cma_mutex);
+		if (!ret) {
+			page = pfn_to_page(pfn);
+			break;
+		}
+
+		mutex_lock(&cma->lock);
+		bitmap_clear(cma->bitmap, bitmap_no, count);
+		if (ret == -EBUSY)
+			cma->nr_busy++;
+		mutex_unlock(&cma->lock);
+		if (ret != -EBUSY)
+			break;
+
+		/* something in there would not move, try further along */
+		start = bitmap_no + mask + 1;
+	}
+	us = ktime_to_us(ktime_sub(ktime_get(), t0));
+
+	mutex_lock(&cma->lock);
+	if (page) {
+		cma->nr_allocs++;
+		cma->last_alloc_us = us;
+		cma->max_alloc_us = max(cma->max_alloc_us, us);
+		cma->total_alloc_us += us;
+	} else
+		cma->nr_fails++;
+	mutex_unlock(&cma->lock);
+
+	return page;
+}
+EXPORT_SYMBOL(cma_alloc);
+
+/**
+ * cma_release - give back pages from cma_alloc()
+ * @cma: area the pages came from
+ * @pages: first page, as returned by cma_alloc()
+ * @count: number of pages, as passed to cma_alloc()
+ *
+ * Returns false if @pages does not belong to @cma.
+ */
+bool cma_release(struct cma *cma, struct page *pages, unsigned long count)
+{
+	unsigned long pfn;
+
+	if (!cma || !pages)
+		return false;
+
+	pfn = page_to_pfn(pages);
+	if (pfn < cma->base_pfn || pfn + count > cma->base_pfn + cma->count)
+		return false;
+
+	free_contig_range(pfn, count);
+
+	mutex_lock(&cma->lock);
+	bitmap_clear(cma->bitmap, pfn - cma->base_pfn, count);
+	mutex_unlock(&cma->lock);
+
+	return true;
+}
+EXPORT_SYMBOL(cma_release);
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * /sys/kernel/debug/cma/<name>/alloc and free let an area be exercised
+ * from userspace: fill memory with page cache, then time allocations of
+ * various sizes through the statistics files.
+ */
+struct cma_test_alloc {
+	struct list_head	list;
+	struct page		*pages;
+	unsigned long		count;
+};
+
+static DEFINE_MUTEX(cma_test_lock);
+static LIST_HEAD(cma_test_allocs);
+
+static int cma_used_get(void *data, u64 *val)
+{
+	struct cma *cma = data;
+
+	mutex_lock(&cma->lock);
+	*val = bitmap_weight(cma->bitmap, cma->count);
+	mutex_unlock(&cma->lock);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(cma_used_fops, cma_used_get, NULL, "%llu\n");
+
+static int cma_count_get(void *data, u64 *val)
+{
+	struct cma *cma = data;
+
+	*val = cma->count;
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(cma_count_fops, cma_count_get, NULL, "%llu\n");
+
+static int cma_test_alloc_set(void *data, u64 val)
+{
+	struct cma *cma = data;
+	struct cma_test_alloc *ta;
+
+	ta = kmalloc(sizeof(*ta), GFP_KERNEL);
+	if (!ta)
+		return -ENOMEM;
+
+	ta->count = val;
+	ta->pages = cma_alloc(cma, ta->count, 0);
+	if (!ta->pages) {
+		kfree(ta);
+		return -ENOMEM;
+	}
+
+	mutex_lock(&cma_test_lock);
+	list_add(&ta->list, &cma_test_allocs);
+	mutex_unlock(&cma_test_lock);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(cma_alloc_fops, NULL, cma_test_alloc_set, "%llu\n");
+
+/* Release up to @val of the newest test allocations from this area */
+static int cma_test_free_set(void *data, u64 val)
+{
+	struct cma *cma = data;
+	struct cma_test_alloc *ta, *tmp;
+
+	mutex_lock(&cma_test_lock);
+	list_for_each_entry_safe(ta, tmp, &cma_test_allocs, list) {
+		if (!val)
+			break;
+		if (!cma_release(cma, ta->pages, ta->count))
+			continue;
+		list_del(&ta->list);
+		kfree(ta);
+		val--;
+	}
+	mutex_unlock(&cma_test_lock);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(cma_free_fops, NULL, cma_test_free_set, "%llu\n");
+
+static int __init cma_debugfs_init(void)
+{
+	struct dentry *root, *dir;
+	unsigned i;
+
+	if (!cma_area_count)
+		return 0;
+
+	root = debugfs_create_dir("cma", NULL);
+	if (!root)
+		return -ENOMEM;
+
+	for (i = 0; i < cma_area_count; i++) {
+		struct cma *cma = &cma_areas[i];
+
+		if (!cma->count)
+			continue;
+
+		dir = debugfs_create_dir(cma->name, root);
+		if (!dir)
+			continue;
+
+		debugfs_create_file("count", 0444, dir, cma, &cma_count_fops);
+		debugfs_create_file("used", 0444, dir, cma, &cma_used_fops);
+		debugfs_create_file("alloc", 0200, dir, cma, &cma_alloc_fops);
+		debugfs_create_file("free", 0200, dir, cma, &cma_free_fops);
+		debugfs_create_u32("nr_allocs", 0444, dir, &cma->nr_allocs);
+		debugfs_create_u32("nr_fails", 0444, dir, &cma->nr_fails);
+		debugfs_create_u32("nr_busy", 0444, dir, &cma->nr_busy);
+		debugfs_create_u64("last_alloc_us", 0444, dir,
+				   &cma->last_alloc_us);
+		debugfs_create_u64("max_alloc_us", 0444, dir,
+				   &cma->max_alloc_us);
+		debugfs_create_u64("total_alloc_us", 0444, dir,
+				   &cma->total_alloc_us);
+	}
+
+	return 0;
+}
+late_initcall(cma_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
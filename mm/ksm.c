@@ -33,6 +33,7 @@
 #include <linux/mmu_notifier.h>
 #include <linux/swap.h>
 #include <linux/ksm.h>
+#include <linux/math64.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -82,21 +83,48 @@
  * @link: link to the mm_slots hash list
  * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
+ * @vma_list: head for this mm_slot's list of vma_yields
  * @mm: the mm that this information is valid for
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
+	struct list_head vma_list;
 	struct mm_struct *mm;
 };
 
+/**
+ * struct vma_yield - merge history of one mergeable vma
+ * @list: link into the mm_slot's vma_list
+ * @start: vm_start of the vma this history belongs to
+ * @seqnr: last full scan which reached this vma
+ * @scanned: pages of the vma scanned in this full scan
+ * @stable: pages of the vma found in the stable tree in this full scan
+ * @last_stable: the same count for the previous full scan it was scanned in
+ * @passes: full scans it was scanned in, up to KSM_YIELD_WARMUP
+ * @backoff: full scans it was last skipped for
+ * @skip: full scans still to be skipped
+ */
+struct vma_yield {
+	struct list_head list;
+	unsigned long start;
+	unsigned long seqnr;
+	unsigned long scanned;
+	unsigned long stable;
+	unsigned long last_stable;
+	unsigned int passes;
+	unsigned int backoff;
+	unsigned int skip;
+};
+
 /**
  * struct ksm_scan - cursor for scanning
  * @mm_slot: the current mm_slot we are scanning
  * @address: the next address inside that to be scanned
  * @rmap_list: link to the next rmap to be scanned in the rmap_list
  * @seqnr: count of completed full scans (needed when removing unstable node)
+ * @vma_yield: merge history of the vma being scanned, if it is tracked
  *
  * There is only the one ksm_scan instance of this cursor structure.
  */
@@ -105,6 +133,7 @@ struct ksm_scan {
 	unsigned long address;
 	struct rmap_item **rmap_list;
 	unsigned long seqnr;
+	struct vma_yield *vma_yield;
 };
 
 /**
@@ -158,6 +187,7 @@ static struct hlist_head *mm_slots_hash;
 
 static struct mm_slot ksm_mm_head = {
 	.mm_list = LIST_HEAD_INIT(ksm_mm_head.mm_list),
+	.vma_list = LIST_HEAD_INIT(ksm_mm_head.vma_list),
 };
 static struct ksm_scan ksm_scan = {
 	.mm_slot = &ksm_mm_head,
@@ -185,6 +215,24 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Most full scans a vma which gained no merged pages may be skipped for */
+static unsigned int ksm_skip_scans_max = 8;
+
+/* Full scans a vma is always scanned in before it may be skipped */
+#define KSM_YIELD_WARMUP	3
+
+/* The number of page slots merged by ksmd */
+static unsigned long ksm_pages_merged;
+
+/* The number of page slots passed over in skipped vmas */
+static unsigned long ksm_pages_skipped;
+
+/* The number of page slots not searched for because their checksum changed */
+static unsigned long ksm_pages_changed;
+
+/* CPU time ksmd spent scanning, in nanoseconds */
+static u64 ksm_scan_cpu_ns;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -266,6 +314,10 @@ static inline struct mm_slot *alloc_mm_slot(void)
 
 static inline void free_mm_slot(struct mm_slot *mm_slot)
 {
+	struct vma_yield *vma_yield, *next;
+
+	list_for_each_entry_safe(vma_yield, next, &mm_slot->vma_list, list)
+		kfree(vma_yield);
 	kmem_cache_free(mm_slot_cache, mm_slot);
 }
 
@@ -634,6 +686,8 @@ static int unmerge_and_remove_all_rmap_items(void)
 	struct vm_area_struct *vma;
 	int err = 0;
 
+	ksm_scan.vma_yield = NULL;
+
 	spin_lock(&ksm_mmlist_lock);
 	ksm_scan.mm_slot = list_entry(ksm_mm_head.mm_list.next,
 						struct mm_slot, mm_list);
@@ -1159,7 +1213,23 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 
 	remove_rmap_item_from_tree(rmap_item);
 
-	/* We first start with searching the page inside the stable tree */
+	/*
+	 * If the hash value of the page has changed from the last time
+	 * we calculated it, this page is changing frequently: therefore we
+	 * don't want to insert it in the unstable tree, and we don't want
+	 * to waste our time searching for something identical to it in
+	 * either tree.  One checksum is much cheaper than the memcmps of a
+	 * stable tree walk, so this filter goes first; the price is that a
+	 * page first seen identical to a ksm page merges one scan later.
+	 */
+	checksum = calc_checksum(page);
+	if (rmap_item->oldchecksum != checksum) {
+		rmap_item->oldchecksum = checksum;
+		ksm_pages_changed++;
+		return;
+	}
+
+	/* Then see if the page can join a page in the stable tree */
 	kpage = stable_tree_search(page);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
@@ -1171,23 +1241,12 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			lock_page(kpage);
 			stable_tree_append(rmap_item, page_stable_node(kpage));
 			unlock_page(kpage);
+			ksm_pages_merged++;
 		}
 		put_page(kpage);
 		return;
 	}
 
-	/*
-	 * If the hash value of the page has changed from the last time
-	 * we calculated it, this page is changing frequently: therefore we
-	 * don't want to insert it in the unstable tree, and we don't want
-	 * to waste our time searching for something identical to it there.
-	 */
-	checksum = calc_checksum(page);
-	if (rmap_item->oldchecksum != checksum) {
-		rmap_item->oldchecksum = checksum;
-		return;
-	}
-
 	tree_rmap_item =
 		unstable_tree_search_insert(rmap_item, page, &tree_page);
 	if (tree_rmap_item) {
@@ -1207,6 +1266,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			if (stable_node) {
 				stable_tree_append(tree_rmap_item, stable_node);
 				stable_tree_append(rmap_item, stable_node);
+				ksm_pages_merged += 2;
 			}
 			unlock_page(kpage);
 
@@ -1252,6 +1312,109 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
+/*
+ * Close the books on the vma just scanned: if none of its pages joined
+ * the stable tree this time, skip it for the next full scan, then for
+ * twice as many after each further such scan, up to ksm_skip_scans_max.
+ */
+static void vma_yield_leave(void)
+{
+	struct vma_yield *vma_yield = ksm_scan.vma_yield;
+
+	if (!vma_yield)
+		return;
+	ksm_scan.vma_yield = NULL;
+
+	if (vma_yield->passes < KSM_YIELD_WARMUP) {
+		vma_yield->passes++;
+		vma_yield->backoff = 0;
+	} else if (vma_yield->stable > vma_yield->last_stable) {
+		vma_yield->backoff = 0;
+	} else if (vma_yield->scanned) {
+		vma_yield->backoff = min(max(vma_yield->backoff * 2, 1U),
+					 ksm_skip_scans_max);
+		vma_yield->skip = vma_yield->backoff;
+	}
+
+	vma_yield->last_stable = vma_yield->stable;
+	vma_yield->stable = 0;
+	vma_yield->scanned = 0;
+}
+
+/*
+ * The scan has reached the start of a mergeable vma: look up its merge
+ * history, and return 1 if the vma is to be skipped in this full scan.
+ */
+static int vma_yield_enter(struct mm_slot *mm_slot, struct vm_area_struct *vma)
+{
+	struct vma_yield *vma_yield = ksm_scan.vma_yield;
+
+	if (vma_yield && vma_yield->start == vma->vm_start)
+		return 0;
+	vma_yield_leave();
+
+	list_for_each_entry(vma_yield, &mm_slot->vma_list, list)
+		if (vma_yield->start == vma->vm_start)
+			goto found;
+
+	vma_yield = kzalloc(sizeof(*vma_yield), GFP_KERNEL);
+	if (!vma_yield)
+		return 0;
+	vma_yield->start = vma->vm_start;
+	list_add(&vma_yield->list, &mm_slot->vma_list);
+found:
+	vma_yield->seqnr = ksm_scan.seqnr;
+	if (vma_yield->skip) {
+		vma_yield->skip--;
+		ksm_pages_skipped += vma_pages(vma);
+		return 1;
+	}
+	ksm_scan.vma_yield = vma_yield;
+	return 0;
+}
+
+/*
+ * Forget the history of vmas which the full scan did not reach:
+ * they have been unmapped, or moved to a different start.
+ */
+static void prune_vma_yields(struct mm_slot *mm_slot)
+{
+	struct vma_yield *vma_yield, *next;
+
+	list_for_each_entry_safe(vma_yield, next, &mm_slot->vma_list, list) {
+		if (vma_yield->seqnr != ksm_scan.seqnr) {
+			list_del(&vma_yield->list);
+			kfree(vma_yield);
+		}
+	}
+}
+
+/*
+ * Move the cursor over a skipped vma.  Its rmap_items are kept, so stable
+ * ones stay listed from their stable_node; but any left over from the last
+ * unstable tree are taken out of it, as that tree is rebuilt by each scan.
+ * rmap_items below the vma belong to nothing mapped: free them as
+ * get_next_rmap_item would.
+ */
+static void skip_vma_rmap_items(struct vm_area_struct *vma)
+{
+	struct rmap_item *rmap_item;
+
+	while ((rmap_item = *ksm_scan.rmap_list) &&
+	       rmap_item->address < vma->vm_end) {
+		if (rmap_item->address < vma->vm_start) {
+			*ksm_scan.rmap_list = rmap_item->rmap_list;
+			remove_rmap_item_from_tree(rmap_item);
+			free_rmap_item(rmap_item);
+			continue;
+		}
+		if (rmap_item->address & UNSTABLE_FLAG)
+			remove_rmap_item_from_tree(rmap_item);
+		ksm_scan.rmap_list = &rmap_item->rmap_list;
+	}
+	ksm_scan.address = vma->vm_end;
+}
+
 static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 {
 	struct mm_struct *mm;
@@ -1289,6 +1452,9 @@ next_mm:
 			ksm_scan.address = vma->vm_start;
 		if (!vma->anon_vma)
 			ksm_scan.address = vma->vm_end;
+		else if (ksm_scan.address == vma->vm_start &&
+			 vma_yield_enter(slot, vma))
+			skip_vma_rmap_items(vma);
 
 		while (ksm_scan.address < vma->vm_end) {
 			if (ksm_test_exit(mm))
@@ -1325,6 +1491,9 @@ next_mm:
 	 */
 	remove_trailing_rmap_items(slot, ksm_scan.rmap_list);
 
+	vma_yield_leave();
+	prune_vma_yields(slot);
+
 	spin_lock(&ksm_mmlist_lock);
 	ksm_scan.mm_slot = list_entry(slot->mm_list.next,
 						struct mm_slot, mm_list);
@@ -1376,6 +1545,11 @@ static void ksm_do_scan(unsigned int scan_npages)
 			return;
 		if (!PageKsm(page) || !in_stable_tree(rmap_item))
 			cmp_and_merge_page(page, rmap_item);
+		if (ksm_scan.vma_yield) {
+			ksm_scan.vma_yield->scanned++;
+			if (in_stable_tree(rmap_item))
+				ksm_scan.vma_yield->stable++;
+		}
 		put_page(page);
 	}
 }
@@ -1391,8 +1565,12 @@ static int ksm_scan_thread(void *nothing)
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
+		if (ksmd_should_run()) {
+			u64 start = task_sched_runtime(current);
+
 			ksm_do_scan(ksm_thread_pages_to_scan);
+			ksm_scan_cpu_ns += task_sched_runtime(current) - start;
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		if (ksmd_should_run()) {
@@ -1457,6 +1635,7 @@ int __ksm_enter(struct mm_struct *mm)
 	mm_slot = alloc_mm_slot();
 	if (!mm_slot)
 		return -ENOMEM;
+	INIT_LIST_HEAD(&mm_slot->vma_list);
 
 	/* Check ksm_run too?  Would need tighter locking */
 	needs_wakeup = list_empty(&ksm_mm_head.mm_list);
@@ -1821,6 +2000,29 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t skip_scans_max_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_skip_scans_max);
+}
+
+static ssize_t skip_scans_max_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	int err;
+	unsigned long scans;
+
+	err = strict_strtoul(buf, 10, &scans);
+	if (err || scans > UINT_MAX)
+		return -EINVAL;
+
+	ksm_skip_scans_max = scans;
+
+	return count;
+}
+KSM_ATTR(skip_scans_max);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -1913,6 +2115,49 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
+static ssize_t pages_skipped_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_skipped);
+}
+KSM_ATTR_RO(pages_skipped);
+
+static ssize_t pages_changed_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_changed);
+}
+KSM_ATTR_RO(pages_changed);
+
+static ssize_t scan_cpu_msecs_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n",
+		       (unsigned long long)div_u64(ksm_scan_cpu_ns,
+						   NSEC_PER_MSEC));
+}
+KSM_ATTR_RO(scan_cpu_msecs);
+
+static ssize_t cpu_usecs_per_merge_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	unsigned long merged = ksm_pages_merged;
+	u64 usecs = 0;
+
+	if (merged)
+		usecs = div64_u64(div_u64(ksm_scan_cpu_ns, NSEC_PER_USEC),
+				  merged);
+	return sprintf(buf, "%llu\n", (unsigned long long)usecs);
+}
+KSM_ATTR_RO(cpu_usecs_per_merge);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -1922,6 +2167,12 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&skip_scans_max_attr.attr,
+	&pages_merged_attr.attr,
+	&pages_skipped_attr.attr,
+	&pages_changed_attr.attr,
+	&scan_cpu_msecs_attr.attr,
+	&cpu_usecs_per_merge_attr.attr,
 	NULL,
 };
 
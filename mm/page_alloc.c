@@ -50,6 +50,8 @@
 #include <linux/kmemleak.h>
 #include <linux/memory.h>
 #include <linux/compaction.h>
+#include <linux/migrate.h>
+#include <linux/mm_inline.h>
 #include <trace/events/kmem.h>
 #include <linux/ftrace_event.h>
 
@@ -819,11 +821,16 @@ struct page *__rmqueue_smallest(struct zone *zone, unsigned int order,
  * This array describes the order lists are fallen back to when
  * the free lists for the desirable migrate type are depleted
  */
-static int fallbacks[MIGRATE_TYPES][MIGRATE_TYPES-1] = {
-	[MIGRATE_UNMOVABLE]   = { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE,   MIGRATE_RESERVE },
-	[MIGRATE_RECLAIMABLE] = { MIGRATE_UNMOVABLE,   MIGRATE_MOVABLE,   MIGRATE_RESERVE },
-	[MIGRATE_MOVABLE]     = { MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
-	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE,     MIGRATE_RESERVE,   MIGRATE_RESERVE }, /* Never used */
+static int fallbacks[MIGRATE_TYPES][4] = {
+	[MIGRATE_UNMOVABLE]   = { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE,     MIGRATE_RESERVE },
+	[MIGRATE_RECLAIMABLE] = { MIGRATE_UNMOVABLE,   MIGRATE_MOVABLE,     MIGRATE_RESERVE },
+#ifdef CONFIG_CMA
+	[MIGRATE_MOVABLE]     = { MIGRATE_CMA,         MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
+	[MIGRATE_CMA]         = { MIGRATE_RESERVE }, /* Never used */
+#else
+	[MIGRATE_MOVABLE]     = { MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE,   MIGRATE_RESERVE },
+#endif
+	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE }, /* Never used */
 };
 
 /*
@@ -919,12 +926,12 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 	/* Find the largest possible block of pages in the other list */
 	for (current_order = MAX_ORDER-1; current_order >= order;
 						--current_order) {
-		for (i = 0; i < MIGRATE_TYPES - 1; i++) {
+		for (i = 0; i < ARRAY_SIZE(fallbacks[0]); i++) {
 			migratetype = fallbacks[start_migratetype][i];
 
 			/* MIGRATE_RESERVE handled later if necessary */
 			if (migratetype == MIGRATE_RESERVE)
-				continue;
+				break;
 
 			area = &(zone->free_area[current_order]);
 			if (list_empty(&area->free_list[migratetype]))
@@ -938,11 +945,13 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			 * If breaking a large block of pages, move all free
 			 * pages to the preferred allocation list. If falling
 			 * back for a reclaimable kernel allocation, be more
-			 * agressive about taking ownership of free pages
+			 * agressive about taking ownership of free pages.
+			 * MIGRATE_CMA pageblocks are only ever borrowed.
 			 */
-			if (unlikely(current_order >= (pageblock_order >> 1)) ||
-					start_migratetype == MIGRATE_RECLAIMABLE ||
-					page_group_by_mobility_disabled) {
+			if (!is_migrate_cma(migratetype) &&
+			    (current_order >= pageblock_order / 2 ||
+			     start_migratetype == MIGRATE_RECLAIMABLE ||
+			     page_group_by_mobility_disabled)) {
 				unsigned long pages;
 				pages = move_freepages_block(zone, page,
 								start_migratetype);
@@ -961,7 +970,8 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			rmv_page_order(page);
 
 			/* Take ownership for orders >= pageblock_order */
-			if (current_order >= pageblock_order)
+			if (current_order >= pageblock_order &&
+			    !is_migrate_cma(migratetype))
 				change_pageblock_range(page, current_order,
 							start_migratetype);
 
@@ -1037,7 +1047,11 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 			list_add(&page->lru, list);
 		else
 			list_add_tail(&page->lru, list);
-		set_page_private(page, migratetype);
+		/* Borrowed CMA pages must go back to their own free list */
+		if (is_migrate_cma(get_pageblock_migratetype(page)))
+			set_page_private(page, MIGRATE_CMA);
+		else
+			set_page_private(page, migratetype);
 		list = &page->lru;
 	}
 	__mod_zone_page_state(zone, NR_FREE_PAGES, -(i << order));
@@ -1200,6 +1214,20 @@ out:
 	local_irq_restore(flags);
 }
 
+/*
+ * Free a list of 0-order pages whose reference count already dropped to zero
+ */
+void free_hot_cold_page_list(struct list_head *list, int cold)
+{
+	struct page *page, *next;
+
+	list_for_each_entry_safe(page, next, list, lru) {
+		trace_mm_pagevec_free(page, cold);
+		free_hot_cold_page(page, cold);
+	}
+	INIT_LIST_HEAD(list);
+}
+
 /*
  * split_page takes a non-compound higher-order page, and splits it into
  * n (1<<order) sub-pages: page[0..n]
@@ -1266,8 +1294,11 @@ int split_free_page(struct page *page)
 
 	if (order >= pageblock_order - 1) {
 		struct page *endpage = page + (1 << order) - 1;
-		for (; page < endpage; page += pageblock_nr_pages)
-			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+		for (; page < endpage; page += pageblock_nr_pages) {
+			if (!is_migrate_cma(get_pageblock_migratetype(page)))
+				set_pageblock_migratetype(page,
+							  MIGRATE_MOVABLE);
+		}
 	}
 
 	return 1 << order;
@@ -2214,6 +2245,204 @@ void free_pages(unsigned long addr, unsigned int order)
 
 EXPORT_SYMBOL(free_pages);
 
+/*
+ * The bulk helpers below take zone->lock for at most this many pages at a
+ * time, so a long request does not hold interrupts off for too long.
+ */
+#define PAGES_BULK_BATCH	32
+
+static unsigned long rmqueue_pages_bulk(struct zone *preferred_zone,
+			struct zone *zone, unsigned int order,
+			int migratetype, unsigned long count,
+			struct page **pages)
+{
+	unsigned long flags;
+	unsigned long i;
+
+	spin_lock_irqsave(&zone->lock, flags);
+	for (i = 0; i < count; i++) {
+		pages[i] = __rmqueue(zone, order, migratetype);
+		if (unlikely(!pages[i]))
+			break;
+	}
+	spin_unlock(&zone->lock);
+
+	if (i) {
+		__mod_zone_page_state(zone, NR_FREE_PAGES,
+				      -(int)(i << order));
+		__count_zone_vm_events(PGALLOC, zone, i << order);
+	}
+	for (count = 0; count < i; count++)
+		zone_statistics(preferred_zone, zone);
+	local_irq_restore(flags);
+
+	return i;
+}
+
+/**
+ * alloc_pages_bulk - allocate a number of pages of the same order
+ * @gfp_mask: GFP flags for the allocation
+ * @order: order of each allocation
+ * @nr_pages: number of allocations wanted
+ * @pages: array filled with the allocated pages
+ *
+ * Pages are taken straight off the buddy free lists, up to
+ * PAGES_BULK_BATCH per hold of zone->lock, for as long as the zone stays
+ * above its low watermark.  Whatever cannot be satisfied that way goes
+ * through the regular allocator one page at a time, so reclaim and the
+ * other slow path rules still apply.
+ *
+ * Returns the number of pages stored at the start of @pages, which may be
+ * less than @nr_pages if the allocation failed part way.  The entries
+ * past those are set to NULL.
+ */
+unsigned long alloc_pages_bulk(gfp_t gfp_mask, unsigned int order,
+			       unsigned long nr_pages, struct page **pages)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	int migratetype = allocflags_to_migratetype(gfp_mask);
+	struct zonelist *zonelist = node_zonelist(numa_node_id(), gfp_mask);
+	struct zone *preferred_zone;
+	struct zone *zone;
+	struct zoneref *z;
+	unsigned long nr = 0;
+
+	gfp_mask &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(gfp_mask);
+
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	if (should_fail_alloc_page(gfp_mask, order) ||
+	    unlikely(!zonelist->_zonerefs->zone))
+		goto fallback;
+
+	get_mems_allowed();
+	first_zones_zonelist(zonelist, high_zoneidx, NULL, &preferred_zone);
+	if (!preferred_zone) {
+		put_mems_allowed();
+		goto fallback;
+	}
+
+	for_each_zone_zonelist(zone, z, zonelist, high_zoneidx) {
+		if (!cpuset_zone_allowed_softwall(zone,
+						  gfp_mask | __GFP_HARDWALL))
+			continue;
+
+		while (nr < nr_pages) {
+			unsigned long want, got, base, i;
+
+			want = min_t(unsigned long, nr_pages - nr,
+				     PAGES_BULK_BATCH);
+			if (!zone_watermark_ok(zone, order,
+					low_wmark_pages(zone) + (want << order),
+					zone_idx(preferred_zone), 0))
+				break;
+
+			base = nr;
+			got = rmqueue_pages_bulk(preferred_zone, zone, order,
+						 migratetype, want,
+						 pages + base);
+			for (i = 0; i < got; i++) {
+				struct page *page = pages[base + i];
+
+				VM_BUG_ON(bad_range(zone, page));
+				if (prep_new_page(page, order, gfp_mask))
+					continue;
+				trace_mm_page_alloc(page, order, gfp_mask,
+						    migratetype);
+				pages[nr++] = page;
+			}
+			if (got < want)
+				break;
+		}
+		if (nr == nr_pages)
+			break;
+	}
+	put_mems_allowed();
+
+fallback:
+	while (nr < nr_pages) {
+		struct page *page = alloc_pages(gfp_mask, order);
+
+		if (!page)
+			break;
+		pages[nr++] = page;
+	}
+
+	/* pages that failed prep_new_page() may have been left behind */
+	if (nr < nr_pages)
+		memset(pages + nr, 0, (nr_pages - nr) * sizeof(*pages));
+
+	return nr;
+}
+EXPORT_SYMBOL(alloc_pages_bulk);
+
+/**
+ * free_pages_bulk - drop a reference on a number of pages of the same order
+ * @nr_pages: number of entries in @pages
+ * @pages: pages to release, NULL entries are skipped
+ * @order: order of each allocation
+ *
+ * Equivalent to calling __free_pages() on every entry, except that pages
+ * whose last reference goes away are handed back to the buddy lists
+ * directly, up to PAGES_BULK_BATCH per hold of zone->lock, instead of
+ * passing through the per-cpu lists.  The contents of @pages are
+ * clobbered.
+ */
+void free_pages_bulk(unsigned long nr_pages, struct page **pages,
+		     unsigned int order)
+{
+	struct zone *zone;
+	unsigned long flags;
+	unsigned long i, nr = 0;
+	int batch;
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = pages[i];
+		int wasMlocked;
+
+		if (!page || !put_page_testzero(page))
+			continue;
+
+		wasMlocked = __TestClearPageMlocked(page);
+		if (!free_pages_prepare(page, order))
+			continue;
+		if (unlikely(wasMlocked)) {
+			local_irq_save(flags);
+			free_page_mlock(page);
+			local_irq_restore(flags);
+		}
+		pages[nr++] = page;
+	}
+	if (!nr)
+		return;
+
+	count_vm_events(PGFREE, nr << order);
+
+	i = 0;
+	while (i < nr) {
+		zone = page_zone(pages[i]);
+		spin_lock_irqsave(&zone->lock, flags);
+		zone->all_unreclaimable = 0;
+		zone->pages_scanned = 0;
+
+		for (batch = 0; i < nr && batch < PAGES_BULK_BATCH; batch++) {
+			struct page *page = pages[i];
+
+			if (page_zone(page) != zone)
+				break;
+			__free_one_page(page, zone, order,
+					get_pageblock_migratetype(page));
+			i++;
+		}
+
+		__mod_zone_page_state(zone, NR_FREE_PAGES, batch << order);
+		spin_unlock_irqrestore(&zone->lock, flags);
+	}
+}
+EXPORT_SYMBOL(free_pages_bulk);
+
 /**
  * alloc_pages_exact - allocate an exact number physically-contiguous pages.
  * @size: the number of bytes to allocate
@@ -5303,6 +5532,7 @@ int set_migratetype_isolate(struct page *page)
 
 	spin_lock_irqsave(&zone->lock, flags);
 	if (get_pageblock_migratetype(page) == MIGRATE_MOVABLE ||
+	    is_migrate_cma(get_pageblock_migratetype(page)) ||
 	    zone_idx == ZONE_MOVABLE) {
 		ret = 0;
 		goto out;
@@ -5355,7 +5585,7 @@ out:
 	return ret;
 }
 
-void unset_migratetype_isolate(struct page *page)
+void unset_migratetype_isolate(struct page *page, unsigned migratetype)
 {
 	struct zone *zone;
 	unsigned long flags;
@@ -5363,12 +5593,245 @@ void unset_migratetype_isolate(struct page *page)
 	spin_lock_irqsave(&zone->lock, flags);
 	if (get_pageblock_migratetype(page) != MIGRATE_ISOLATE)
 		goto out;
-	set_pageblock_migratetype(page, MIGRATE_MOVABLE);
-	move_freepages_block(zone, page, MIGRATE_MOVABLE);
+	set_pageblock_migratetype(page, migratetype);
+	move_freepages_block(zone, page, migratetype);
 out:
 	spin_unlock_irqrestore(&zone->lock, flags);
 }
 
+#ifdef CONFIG_CMA
+/*
+ * Hand a pageblock that was reserved at boot for a contiguous memory area
+ * over to the buddy allocator.  Movable allocations may borrow it until
+ * alloc_contig_range() wants it back.
+ */
+void __init init_cma_reserved_pageblock(struct page *page)
+{
+	unsigned i = pageblock_nr_pages;
+	struct page *p = page;
+
+	do {
+		__ClearPageReserved(p);
+		set_page_count(p, 0);
+	} while (++p, --i);
+
+	set_page_refcounted(page);
+	set_pageblock_migratetype(page, MIGRATE_CMA);
+	__free_pages(page, pageblock_order);
+	totalram_pages += pageblock_nr_pages;
+}
+
+/* Same batch as memory hot-remove, and as many attempts per batch */
+#define NR_CONTIG_MIGRATE_PAGES		256
+#define NR_CONTIG_MIGRATE_TRIES		5
+
+static struct page *
+contig_migrate_alloc(struct page *page, unsigned long private, int **x)
+{
+	return alloc_page(GFP_HIGHUSER_MOVABLE);
+}
+
+/*
+ * Take up to NR_CONTIG_MIGRATE_PAGES pages in use in [pfn, end_pfn) off the
+ * LRU.  Returns the pfn the scan stopped at.
+ */
+static unsigned long
+isolate_contig_lru_pages(unsigned long pfn, unsigned long end_pfn,
+			 struct list_head *list)
+{
+	int nr = 0;
+
+	for (; pfn < end_pfn && nr < NR_CONTIG_MIGRATE_PAGES; pfn++) {
+		struct page *page;
+
+		if (!pfn_valid_within(pfn))
+			continue;
+		page = pfn_to_page(pfn);
+		if (!page_count(page) || !PageLRU(page))
+			continue;
+		if (isolate_lru_page(page))
+			continue;
+
+		list_add_tail(&page->lru, list);
+		inc_zone_page_state(page, NR_ISOLATED_ANON +
+				    page_is_file_cache(page));
+		nr++;
+	}
+
+	return pfn;
+}
+
+static int contig_migrate_range(unsigned long start_pfn,
+				unsigned long end_pfn)
+{
+	unsigned long pfn = start_pfn;
+	unsigned long next;
+	int tries = 0;
+	int ret;
+	LIST_HEAD(source);
+
+	migrate_prep();
+
+	while (pfn < end_pfn) {
+		if (fatal_signal_pending(current))
+			return -EINTR;
+
+		next = isolate_contig_lru_pages(pfn, end_pfn, &source);
+		if (!list_empty(&source)) {
+			/* returns the number of pages left where they were */
+			ret = migrate_pages(&source, contig_migrate_alloc,
+					    0, 0);
+			if (ret) {
+				if (++tries < NR_CONTIG_MIGRATE_TRIES)
+					continue;
+				return ret < 0 ? ret : -EBUSY;
+			}
+		}
+		tries = 0;
+		pfn = next;
+	}
+
+	return 0;
+}
+
+static unsigned long pfn_max_align_down(unsigned long pfn)
+{
+	return pfn & ~(max_t(unsigned long, MAX_ORDER_NR_PAGES,
+			     pageblock_nr_pages) - 1);
+}
+
+static unsigned long pfn_max_align_up(unsigned long pfn)
+{
+	return ALIGN(pfn, max_t(unsigned long, MAX_ORDER_NR_PAGES,
+				pageblock_nr_pages));
+}
+
+/**
+ * alloc_contig_range - allocate a range of physically contiguous pages
+ * @start_pfn: first pfn of the range
+ * @end_pfn: one past the last pfn of the range
+ * @migratetype: migrate type of the pageblocks, restored afterwards
+ *
+ * The pageblocks covering the range are isolated so nothing new is handed
+ * out from them, everything in use in the range is migrated elsewhere, and
+ * the now free pages are taken off the buddy lists.  The caller serialises
+ * calls whose ranges share a MAX_ORDER block.
+ *
+ * Returns zero with every page in the range holding one reference, to be
+ * dropped with free_contig_range(), or -EBUSY if some page could not be
+ * moved.
+ */
+int alloc_contig_range(unsigned long start_pfn, unsigned long end_pfn,
+		       unsigned migratetype)
+{
+	unsigned long outer_start, outer_end, pfn, flags;
+	unsigned int order;
+	struct zone *zone;
+	struct page *page;
+	int ret;
+
+	ret = start_isolate_page_range(pfn_max_align_down(start_pfn),
+				       pfn_max_align_up(end_pfn), migratetype);
+	if (ret)
+		return ret;
+
+	ret = contig_migrate_range(start_pfn, end_pfn);
+	if (ret)
+		goto done;
+
+	/* Flush pages that are still on their way to the free lists */
+	lru_add_drain_all();
+	drain_all_pages();
+
+	/*
+	 * The range may start in the middle of a free buddy, find the head
+	 * of it first.
+	 */
+	outer_start = start_pfn;
+	order = 0;
+	while (!PageBuddy(pfn_to_page(outer_start))) {
+		if (++order >= MAX_ORDER) {
+			ret = -EBUSY;
+			goto done;
+		}
+		outer_start &= ~0UL << order;
+	}
+
+	/*
+	 * A buddy found below start_pfn may end before it: then start_pfn
+	 * is not free and the walk below fails on it, rather than on the
+	 * unrelated pages in between.
+	 */
+	if (outer_start + (1UL << page_order(pfn_to_page(outer_start))) <=
+	    start_pfn)
+		outer_start = start_pfn;
+
+	zone = page_zone(pfn_to_page(start_pfn));
+	spin_lock_irqsave(&zone->lock, flags);
+	for (pfn = outer_start; pfn < end_pfn; pfn += 1UL << page_order(page)) {
+		page = pfn_to_page(pfn);
+		if (!PageBuddy(page))
+			break;
+	}
+	if (pfn < end_pfn) {
+		spin_unlock_irqrestore(&zone->lock, flags);
+		ret = -EBUSY;
+		goto done;
+	}
+	outer_end = pfn;
+
+	for (pfn = outer_start; pfn < outer_end; pfn += 1UL << order) {
+		page = pfn_to_page(pfn);
+		order = page_order(page);
+		list_del(&page->lru);
+		zone->free_area[order].nr_free--;
+		rmv_page_order(page);
+		__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+
+		set_page_refcounted(page);
+		split_page(page, order);
+	}
+	spin_unlock_irqrestore(&zone->lock, flags);
+
+	for (pfn = outer_start; pfn < outer_end; pfn++) {
+		page = pfn_to_page(pfn);
+		arch_alloc_page(page, 0);
+		kernel_map_pages(page, 1, 1);
+	}
+
+	/* Give back what the buddies covered beyond the range */
+	if (outer_start != start_pfn)
+		free_contig_range(outer_start, start_pfn - outer_start);
+	if (outer_end != end_pfn)
+		free_contig_range(end_pfn, outer_end - end_pfn);
+
+done:
+	undo_isolate_page_range(pfn_max_align_down(start_pfn),
+				pfn_max_align_up(end_pfn), migratetype);
+	return ret;
+}
+
+/**
+ * free_contig_range - release pages from alloc_contig_range()
+ * @pfn: first pfn of the range
+ * @nr_pages: number of pages
+ */
+void free_contig_range(unsigned long pfn, unsigned long nr_pages)
+{
+	struct page *pages[PAGEVEC_SIZE];
+	unsigned long nr = 0;
+
+	for (; nr_pages--; pfn++) {
+		pages[nr++] = pfn_to_page(pfn);
+		if (nr == ARRAY_SIZE(pages)) {
+			free_pages_bulk(nr, pages, 0);
+			nr = 0;
+		}
+	}
+	free_pages_bulk(nr, pages, 0);
+}
+#endif /* CONFIG_CMA */
+
 #ifdef CONFIG_MEMORY_HOTREMOVE
 /*
  * All pages in the range must be isolated before calling this.
@@ -454,6 +454,7 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		spin_unlock_irq(&mapping->tree_lock);
 		swapcache_free(swap, page);
 	} else {
+		workingset_eviction(mapping, page);
 		__remove_from_page_cache(page);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
@@ -1111,6 +1112,32 @@ static int too_many_isolated(struct zone *zone, int file,
 	return isolated > inactive;
 }
 
+/*
+ * Drop the reference isolation took on a page that has just been put back
+ * on @lru, with zone->lru_lock held.  If that was the last reference the
+ * page comes straight off the LRU again and is queued on @pages_to_free,
+ * to be freed once the lock is released.  This saves dropping and retaking
+ * the lock for every pagevec worth of pages put back.
+ */
+static void put_lru_page_locked(struct zone *zone, struct page *page,
+				enum lru_list lru,
+				struct list_head *pages_to_free)
+{
+	if (likely(!put_page_testzero(page)))
+		return;
+
+	__ClearPageLRU(page);
+	__ClearPageActive(page);
+	del_page_from_lru_list(zone, page, lru);
+
+	if (unlikely(PageCompound(page))) {
+		spin_unlock_irq(&zone->lru_lock);
+		(*get_compound_page_dtor(page))(page);
+		spin_lock_irq(&zone->lru_lock);
+	} else
+		list_add(&page->lru, pages_to_free);
+}
+
 /*
  * shrink_inactive_list() is a helper for shrink_zone().  It returns the number
  * of reclaimed pages
@@ -1120,7 +1147,7 @@ static unsigned long shrink_inactive_list(unsigned long max_scan,
 			int priority, int file)
 {
 	LIST_HEAD(page_list);
-	struct pagevec pvec;
+	LIST_HEAD(pages_to_free);
 	unsigned long nr_scanned = 0;
 	unsigned long nr_reclaimed = 0;
 	struct zone_reclaim_stat *reclaim_stat = get_reclaim_stat(zone, sc);
@@ -1133,9 +1160,6 @@ static unsigned long shrink_inactive_list(unsigned long max_scan,
 			return SWAP_CLUSTER_MAX;
 	}
 
-
-	pagevec_init(&pvec, 1);
-
 	lru_add_drain();
 	spin_lock_irq(&zone->lru_lock);
 	do {
@@ -1251,11 +1275,7 @@ static unsigned long shrink_inactive_list(unsigned long max_scan,
 				int file = is_file_lru(lru);
 				reclaim_stat->recent_rotated[file]++;
 			}
-			if (!pagevec_add(&pvec, page)) {
-				spin_unlock_irq(&zone->lru_lock);
-				__pagevec_release(&pvec);
-				spin_lock_irq(&zone->lru_lock);
-			}
+			put_lru_page_locked(zone, page, lru, &pages_to_free);
 		}
 		__mod_zone_page_state(zone, NR_ISOLATED_ANON, -nr_anon);
 		__mod_zone_page_state(zone, NR_ISOLATED_FILE, -nr_file);
@@ -1264,7 +1284,7 @@ static unsigned long shrink_inactive_list(unsigned long max_scan,
 
 done:
 	spin_unlock_irq(&zone->lru_lock);
-	pagevec_release(&pvec);
+	free_hot_cold_page_list(&pages_to_free, 1);
 	return nr_reclaimed;
 }
 
@@ -1302,14 +1322,12 @@ static inline void note_zone_scanning_priority(struct zone *zone, int priority)
 
 static void move_active_pages_to_lru(struct zone *zone,
 				     struct list_head *list,
+				     struct list_head *pages_to_free,
 				     enum lru_list lru)
 {
 	unsigned long pgmoved = 0;
-	struct pagevec pvec;
 	struct page *page;
 
-	pagevec_init(&pvec, 1);
-
 	while (!list_empty(list)) {
 		page = lru_to_page(list);
 
@@ -1320,13 +1338,7 @@ static void move_active_pages_to_lru(struct zone *zone,
 		mem_cgroup_add_lru_list(page, lru);
 		pgmoved++;
 
-		if (!pagevec_add(&pvec, page) || list_empty(list)) {
-			spin_unlock_irq(&zone->lru_lock);
-			if (buffer_heads_over_limit)
-				pagevec_strip(&pvec);
-			__pagevec_release(&pvec);
-			spin_lock_irq(&zone->lru_lock);
-		}
+		put_lru_page_locked(zone, page, lru, pages_to_free);
 	}
 	__mod_zone_page_state(zone, NR_LRU_BASE + lru, pgmoved);
 	if (!is_active_lru(lru))
@@ -1342,6 +1354,7 @@ static void shrink_active_list(unsigned long nr_pages, struct zone *zone,
 	LIST_HEAD(l_hold);	/* The pages which were snipped off */
 	LIST_HEAD(l_active);
 	LIST_HEAD(l_inactive);
+	LIST_HEAD(pages_to_free);
 	struct page *page;
 	struct zone_reclaim_stat *reclaim_stat = get_reclaim_stat(zone, sc);
 	unsigned long nr_rotated = 0;
@@ -1385,6 +1398,14 @@ static void shrink_active_list(unsigned long nr_pages, struct zone *zone,
 			continue;
 		}
 
+		/* done here, where the page lock may be taken */
+		if (unlikely(buffer_heads_over_limit) &&
+		    page_has_private(page) && trylock_page(page)) {
+			if (page_has_private(page))
+				try_to_release_page(page, 0);
+			unlock_page(page);
+		}
+
 		if (page_referenced(page, 0, sc->mem_cgroup, &vm_flags)) {
 			nr_rotated++;
 			/*
@@ -1418,12 +1439,14 @@ static void shrink_active_list(unsigned long nr_pages, struct zone *zone,
 	 */
 	reclaim_stat->recent_rotated[file] += nr_rotated;
 
-	move_active_pages_to_lru(zone, &l_active,
+	move_active_pages_to_lru(zone, &l_active, &pages_to_free,
 						LRU_ACTIVE + file * LRU_FILE);
-	move_active_pages_to_lru(zone, &l_inactive,
+	move_active_pages_to_lru(zone, &l_inactive, &pages_to_free,
 						LRU_BASE   + file * LRU_FILE);
 	__mod_zone_page_state(zone, NR_ISOLATED_ANON + file, -nr_taken);
 	spin_unlock_irq(&zone->lru_lock);
+
+	free_hot_cold_page_list(&pages_to_free, 1);
 }
 
 static int inactive_anon_is_low_global(struct zone *zone)
@@ -0,0 +1,176 @@
+/*
+ * Workingset detection
+ *
+ * Page cache pages evicted by reclaim leave a record of when they went,
+ * measured in evictions and activations on their zone's inactive file
+ * list.  When the page is read back in, the difference between the zone's
+ * current count and the recorded one is the refault distance: how many
+ * pages the inactive list saw come and go while this page was out.
+ *
+ * Had the page been on the active list instead, it would have survived
+ * those pages as long as the active list is bigger than the distance.  A
+ * page refaulting within that distance is therefore part of the working
+ * set that the inactive list was too small to hold, and it goes straight
+ * to the active list.  Streaming reads never refault, and so never push
+ * the working set out.
+ *
+ * The records live in a lossy hash table keyed by mapping and index,
+ * sized from the amount of memory.  A record that gets overwritten only
+ * costs a missed activation.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/swap.h>
+#include <linux/fs.h>
+#include <linux/hash.h>
+#include <linux/bootmem.h>
+#include <linux/spinlock.h>
+#include <linux/vmstat.h>
+#include <linux/init.h>
+
+struct workingset_shadow {
+	unsigned long	key;		/* 0 for an empty slot */
+	unsigned long	eviction;	/* inactive_age, node and zone */
+};
+
+#define EVICTION_SHIFT	(NODES_SHIFT + ZONES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static struct workingset_shadow *shadow_table __read_mostly;
+static unsigned int shadow_shift __read_mostly;
+static unsigned int shadow_mask __read_mostly;
+static DEFINE_SPINLOCK(shadow_lock);
+
+static unsigned long shadow_key(struct address_space *mapping, pgoff_t index)
+{
+	unsigned long key;
+
+	key = hash_long((unsigned long)mapping ^ index, BITS_PER_LONG);
+	return key ? key : 1;
+}
+
+static unsigned long pack_eviction(struct zone *zone)
+{
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	return eviction;
+}
+
+static struct zone *unpack_eviction(unsigned long eviction,
+				    unsigned long *age)
+{
+	int zid = eviction & ((1UL << ZONES_SHIFT) - 1);
+	int nid;
+
+	eviction >>= ZONES_SHIFT;
+	nid = eviction & ((1UL << NODES_SHIFT) - 1);
+	eviction >>= NODES_SHIFT;
+
+	*age = eviction;
+	return NODE_DATA(nid)->node_zones + zid;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page cache page
+ * @mapping: address space the page is being removed from
+ * @page: the page being evicted
+ *
+ * Called by reclaim with @mapping->tree_lock held.
+ */
+void workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	unsigned long key = shadow_key(mapping, page->index);
+	struct workingset_shadow *shadow;
+	unsigned long eviction;
+	unsigned long flags;
+
+	if (!shadow_table)
+		return;
+
+	eviction = pack_eviction(page_zone(page));
+	shadow = &shadow_table[key & shadow_mask];
+
+	spin_lock_irqsave(&shadow_lock, flags);
+	shadow->key = key;
+	shadow->eviction = eviction;
+	spin_unlock_irqrestore(&shadow_lock, flags);
+}
+
+/**
+ * workingset_refault - check whether a page being read in was evicted
+ * @mapping: address space the page is being added to
+ * @index: index of the page in @mapping
+ *
+ * Returns true if the page was evicted recently enough that it would have
+ * stayed in memory on the active list, in which case it should be added
+ * to the active list right away.
+ */
+bool workingset_refault(struct address_space *mapping, pgoff_t index)
+{
+	unsigned long key = shadow_key(mapping, index);
+	struct workingset_shadow *shadow;
+	unsigned long eviction, refault, distance;
+	unsigned long flags;
+	struct zone *zone;
+
+	if (!shadow_table)
+		return false;
+
+	shadow = &shadow_table[key & shadow_mask];
+
+	/* the common case of a first read does not need the lock */
+	if (ACCESS_ONCE(shadow->key) != key)
+		return false;
+
+	spin_lock_irqsave(&shadow_lock, flags);
+	if (shadow->key != key) {
+		spin_unlock_irqrestore(&shadow_lock, flags);
+		return false;
+	}
+	eviction = shadow->eviction;
+	shadow->key = 0;
+	spin_unlock_irqrestore(&shadow_lock, flags);
+
+	zone = unpack_eviction(eviction, &eviction);
+	refault = atomic_long_read(&zone->inactive_age);
+	distance = (refault - eviction) & EVICTION_MASK;
+
+	count_vm_event(WORKINGSET_REFAULT);
+	if (distance > zone_page_state(zone, NR_ACTIVE_FILE))
+		return false;
+
+	count_vm_event(WORKINGSET_ACTIVATE);
+	return true;
+}
+
+/**
+ * workingset_activation - note a page cache page being activated
+ * @zone: zone of the page
+ *
+ * Activations push inactive pages towards eviction just like evictions
+ * do, so they advance the clock too.
+ */
+void workingset_activation(struct zone *zone)
+{
+	atomic_long_inc(&zone->inactive_age);
+}
+
+static int __init workingset_init(void)
+{
+	/* one record for every eight pages of memory */
+	shadow_table = alloc_large_system_hash("Workingset shadow",
+					       sizeof(struct workingset_shadow),
+					       totalram_pages / 8, 0, 0,
+					       &shadow_shift, &shadow_mask, 0);
+	if (shadow_table)
+		memset(shadow_table, 0,
+		       sizeof(struct workingset_shadow) << shadow_shift);
+	return 0;
+}
+module_init(workingset_init);
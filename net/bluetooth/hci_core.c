@@ -1274,49 +1274,62 @@ static void hci_add_acl_hdr(struct sk_buff *skb, __u16 handle, __u16 flags)
 	hdr->dlen   = cpu_to_le16(len);
 }
 
+/* Queue the frames of one PDU at once, so that they never end up in
+ * between the fragments of another PDU. Frames of one link are kept in
+ * FIFO order, whatever their priority: L2CAP relies on it, e.g. a
+ * Disconnection Request must not overtake the data sent before it.
+ * Priority only decides which link is served next. */
+static void hci_queue_acl(struct sk_buff_head *queue, struct sk_buff_head *pdu)
+{
+	spin_lock_bh(&queue->lock);
+	skb_queue_splice_tail_init(pdu, queue);
+	spin_unlock_bh(&queue->lock);
+}
+
 void hci_send_acl(struct hci_conn *conn, struct sk_buff *skb, __u16 flags)
 {
 	struct hci_dev *hdev = conn->hdev;
+	__u32 priority = min_t(__u32, skb->priority, HCI_PRIO_MAX);
+	struct sk_buff_head pdu;
 	struct sk_buff *list;
 
 	BT_DBG("%s conn %p flags 0x%x", hdev->name, conn, flags);
 
+	__skb_queue_head_init(&pdu);
+
 	skb->dev = (void *) hdev;
+	skb->priority = priority;
 	bt_cb(skb)->pkt_type = HCI_ACLDATA_PKT;
 	hci_add_acl_hdr(skb, conn->handle, flags);
 
-	if (!(list = skb_shinfo(skb)->frag_list)) {
-		/* Non fragmented */
-		BT_DBG("%s nonfrag skb %p len %d", hdev->name, skb, skb->len);
-
-		skb_queue_tail(&conn->data_q, skb);
-	} else {
-		/* Fragmented */
-		BT_DBG("%s frag %p len %d", hdev->name, skb, skb->len);
-
+	list = skb_shinfo(skb)->frag_list;
+	if (list)
 		skb_shinfo(skb)->frag_list = NULL;
 
-		/* Queue all fragments atomically */
-		spin_lock_bh(&conn->data_q.lock);
+	BT_DBG("%s %s skb %p len %d", hdev->name, list ? "frag" : "nonfrag",
+							skb, skb->len);
 
-		__skb_queue_tail(&conn->data_q, skb);
-		flags &= ~ACL_PB_MASK;
-		flags |= ACL_CONT;
-		do {
-			skb = list; list = list->next;
+	__skb_queue_tail(&pdu, skb);
 
-			skb->dev = (void *) hdev;
-			bt_cb(skb)->pkt_type = HCI_ACLDATA_PKT;
-			hci_add_acl_hdr(skb, conn->handle, flags);
+	/* Continuation fragments go out with the priority of the first */
+	flags &= ~ACL_PB_MASK;
+	flags |= ACL_CONT;
+	while (list) {
+		skb = list; list = list->next;
 
-			BT_DBG("%s frag %p len %d", hdev->name, skb, skb->len);
+		skb->dev = (void *) hdev;
+		skb->priority = priority;
+		bt_cb(skb)->pkt_type = HCI_ACLDATA_PKT;
+		hci_add_acl_hdr(skb, conn->handle, flags);
 
-			__skb_queue_tail(&conn->data_q, skb);
-		} while (list);
+		BT_DBG("%s frag %p len %d", hdev->name, skb, skb->len);
 
-		spin_unlock_bh(&conn->data_q.lock);
+		__skb_queue_tail(&pdu, skb);
 	}
 
+	/* Queue all fragments atomically */
+	hci_queue_acl(&conn->data_q, &pdu);
+
 	tasklet_schedule(&hdev->tx_task);
 }
 EXPORT_SYMBOL(hci_send_acl);
@@ -1404,10 +1417,92 @@ static inline void hci_acl_tx_to(struct hci_dev *hdev)
 	}
 }
 
+/* ACL connection scheduler: of the connections whose next frame has the
+ * highest priority, serve the one with the fewest frames in flight. */
+static inline struct hci_conn *hci_acl_low_sent(struct hci_dev *hdev,
+						__u32 *priority, int *quote)
+{
+	struct hci_conn_hash *h = &hdev->conn_hash;
+	struct hci_conn *conn = NULL;
+	int num = 0, min = ~0;
+	__u32 cur_prio = 0;
+	struct list_head *p;
+
+	/* We don't have to lock device here. Connections are always
+	 * added and removed with TX task disabled. */
+	list_for_each(p, &h->list) {
+		struct hci_conn *c;
+		struct sk_buff *skb;
+		c = list_entry(p, struct hci_conn, list);
+
+		if (c->type != ACL_LINK)
+			continue;
+
+		if (c->state != BT_CONNECTED && c->state != BT_CONFIG)
+			continue;
+
+		skb = skb_peek(&c->data_q);
+		if (!skb || skb->priority < cur_prio)
+			continue;
+
+		if (skb->priority > cur_prio) {
+			cur_prio = skb->priority;
+			num = 0;
+			min = ~0;
+		}
+
+		num++;
+
+		if (c->sent < min) {
+			min  = c->sent;
+			conn = c;
+		}
+	}
+
+	if (conn) {
+		int q = hdev->acl_cnt / num;
+		*quote = q ? q : 1;
+		*priority = cur_prio;
+	} else
+		*quote = 0;
+
+	BT_DBG("conn %p quote %d priority %u", conn, *quote, cur_prio);
+	return conn;
+}
+
+/* Connections that lost out to higher priority traffic in this round
+ * move up, so that bulk transfers still progress next to an A2DP stream. */
+static inline void hci_acl_prio_recalculate(struct hci_dev *hdev)
+{
+	struct hci_conn_hash *h = &hdev->conn_hash;
+	struct list_head *p;
+	struct hci_conn *c;
+	struct sk_buff *skb;
+
+	list_for_each(p, &h->list) {
+		c = list_entry(p, struct hci_conn, list);
+
+		if (c->type != ACL_LINK)
+			continue;
+
+		if (c->tx_served) {
+			c->tx_served = 0;
+			continue;
+		}
+
+		skb = skb_peek(&c->data_q);
+		if (skb && skb->priority < HCI_PRIO_MAX - 1)
+			skb->priority = HCI_PRIO_MAX - 1;
+	}
+}
+
 static inline void hci_sched_acl(struct hci_dev *hdev)
 {
 	struct hci_conn *conn;
+	struct sk_buff_head batch;
 	struct sk_buff *skb;
+	unsigned int cnt = hdev->acl_cnt;
+	__u32 priority;
 	int quote;
 
 	BT_DBG("%s", hdev->name);
@@ -1419,11 +1514,27 @@ static inline void hci_sched_acl(struct hci_dev *hdev)
 			hci_acl_tx_to(hdev);
 	}
 
-	while (hdev->acl_cnt && (conn = hci_low_sent(hdev, ACL_LINK, &quote))) {
-		while (quote-- && (skb = skb_dequeue(&conn->data_q))) {
-			BT_DBG("skb %p len %d", skb, skb->len);
+	__skb_queue_head_init(&batch);
+
+	while (hdev->acl_cnt &&
+			(conn = hci_acl_low_sent(hdev, &priority, &quote))) {
+		/* Take the whole quota at once, up to the first frame
+		 * of lower priority */
+		spin_lock(&conn->data_q.lock);
+		while (quote-- && (skb = skb_peek(&conn->data_q)) &&
+						skb->priority >= priority) {
+			__skb_unlink(skb, &conn->data_q);
+			__skb_queue_tail(&batch, skb);
+		}
+		spin_unlock(&conn->data_q.lock);
 
-			hci_conn_enter_active_mode(conn);
+		if (skb_queue_empty(&batch))
+			break;
+
+		hci_conn_enter_active_mode(conn);
+
+		while ((skb = __skb_dequeue(&batch))) {
+			BT_DBG("skb %p len %d", skb, skb->len);
 
 			hci_send_frame(skb);
 			hdev->acl_last_tx = jiffies;
@@ -1431,7 +1542,12 @@ static inline void hci_sched_acl(struct hci_dev *hdev)
 			hdev->acl_cnt--;
 			conn->sent++;
 		}
+
+		conn->tx_served = 1;
 	}
+
+	if (hdev->acl_cnt != cnt)
+		hci_acl_prio_recalculate(hdev);
 }
 
 /* Schedule SCO */
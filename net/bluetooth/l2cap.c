@@ -349,6 +349,9 @@ static inline void l2cap_send_cmd(struct l2cap_conn *conn, u8 ident, u8 code, u1
 	else
 		flags = ACL_START;
 
+	/* Links with signalling to send are served first */
+	skb->priority = HCI_PRIO_MAX;
+
 	hci_send_acl(conn->hcon, skb, flags);
 }
 
@@ -391,6 +394,8 @@ static inline void l2cap_send_sframe(struct l2cap_pinfo *pi, u16 control)
 		put_unaligned_le16(fcs, skb_put(skb, 2));
 	}
 
+	skb->priority = HCI_PRIO_MAX;
+
 	hci_send_acl(pi->conn->hcon, skb, 0);
 }
 
@@ -1354,6 +1359,9 @@ static inline void l2cap_do_send(struct sock *sk, struct sk_buff *skb)
 	else
 		flags = ACL_START;
 
+	/* SO_PRIORITY of the socket, e.g. high for an A2DP stream */
+	skb->priority = sk->sk_priority;
+
 	hci_send_acl(hcon, skb, flags);
 }
 
@@ -1566,7 +1574,7 @@ static inline int l2cap_skbuff_fromiovec(struct sock *sk, struct msghdr *msg, in
 
 		*frag = bt_skb_send_alloc(sk, count, msg->msg_flags & MSG_DONTWAIT, &err);
 		if (!*frag)
-			return -EFAULT;
+			return err;
 		if (memcpy_fromiovec(skb_put(*frag, count), msg->msg_iov, count))
 			return -EFAULT;
 
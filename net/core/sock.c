@@ -124,6 +124,7 @@
 #include <net/xfrm.h>
 #include <linux/ipsec.h>
 #include <net/cls_cgroup.h>
+#include <net/socktag.h>
 
 #include <linux/filter.h>
 
@@ -1119,6 +1120,7 @@ static void __sk_free(struct sock *sk)
 		printk(KERN_DEBUG "%s: optmem leakage (%d bytes) detected.\n",
 		       __func__, atomic_read(&sk->sk_omem_alloc));
 
+	socktag_sk_free(sk);
 	put_net(sock_net(sk));
 	sk_prot_free(sk->sk_prot_creator, sk);
 }
@@ -1164,6 +1166,13 @@ struct sock *sk_clone(const struct sock *sk, const gfp_t priority)
 		struct sk_filter *filter;
 
 		sock_copy(newsk, sk);
+#ifdef CONFIG_NET_SOCKTAG
+		/*
+		 * Charged to its own owner, see socktag_sk_default().  Clear
+		 * it before sk_free() below could drop the parent's reference.
+		 */
+		newsk->sk_tag_stat = NULL;
+#endif
 
 		/* SANITY */
 		get_net(sock_net(newsk));
@@ -0,0 +1,618 @@
+/*
+ * Forwarding fast path for established IPv4 connections
+ *
+ * Once conntrack has seen a forwarded TCP or UDP connection in both
+ * directions, every further packet of it goes through the same hooks,
+ * the same conntrack lookup and the same NAT rewrite with the same
+ * result.  This module records that result per direction the first time
+ * an established packet leaves through POST_ROUTING: the tuple it
+ * arrived with, the addresses and ports it left with and its route.
+ * Matching packets are then rewritten and handed to the neighbour layer
+ * from the first PRE_ROUTING hook, skipping conntrack, NAT, iptables and
+ * the route lookup.
+ *
+ * The conntrack entry stays authoritative: each fast path packet
+ * refreshes its timeout and accounting without taking nf_conntrack_lock,
+ * and a flow is dropped as soon as the entry dies, the TCP connection
+ * leaves ESTABLISHED or the route goes stale.  All flows are dropped
+ * when an iptables table changes, and packets arriving on a device that
+ * does not forward take the slow path.  TCP packets with SYN,
+ * FIN or RST set always take the slow path so that conntrack sees the
+ * state changes.
+ *
+ * Connections with a helper or sequence adjustment, marked packets,
+ * IP options, fragments, IPsec and packets that would need to be
+ * fragmented are left to the slow path.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/types.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <linux/inetdevice.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter_ipv4.h>
+#include <linux/netfilter/x_tables.h>
+#include <net/ip.h>
+#include <net/route.h>
+#include <net/dst.h>
+#include <net/neighbour.h>
+#include <net/checksum.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_helper.h>
+#include <net/netfilter/nf_conntrack_zones.h>
+
+static int fastpath_enable __read_mostly = 1;
+module_param_named(enable, fastpath_enable, bool, 0644);
+MODULE_PARM_DESC(enable, "forward established flows on the fast path");
+
+static unsigned int fastpath_max __read_mostly = 4096;
+module_param_named(max_flows, fastpath_max, uint, 0644);
+MODULE_PARM_DESC(max_flows, "maximum number of flows on the fast path");
+
+static unsigned int fastpath_idle __read_mostly = 30;
+module_param_named(idle_timeout, fastpath_idle, uint, 0644);
+MODULE_PARM_DESC(idle_timeout, "seconds before an unused flow is dropped");
+
+#define FASTPATH_HASH_BITS	10
+#define FASTPATH_HASH_SIZE	(1 << FASTPATH_HASH_BITS)
+
+/* One direction of a connection */
+struct fastpath_flow {
+	struct hlist_node	hnode;
+
+	/* the packet as it arrives */
+	struct net		*net;
+	int			iif;
+	__be32			saddr, daddr;
+	__be16			sport, dport;
+	u8			protonum;
+
+	/* and as it leaves */
+	__be32			nat_saddr, nat_daddr;
+	__be16			nat_sport, nat_dport;
+	struct dst_entry	*dst;
+
+	struct nf_conn		*ct;
+	enum ip_conntrack_info	ctinfo;
+	unsigned long		timeout;
+	unsigned long		last_used;
+
+	struct rcu_head		rcu;
+};
+
+struct fastpath_stat {
+	unsigned long		hits;
+	unsigned long		added;
+};
+
+static struct hlist_head fastpath_hash[FASTPATH_HASH_SIZE];
+static DEFINE_SPINLOCK(fastpath_lock);	/* guards fastpath_hash writers */
+static unsigned int fastpath_count;
+static int fastpath_generation;		/* xt_table_generation of the flows */
+static u32 fastpath_rnd __read_mostly;
+static DEFINE_PER_CPU(struct fastpath_stat, fastpath_stats);
+static struct kmem_cache *fastpath_cachep __read_mostly;
+
+/* deferrable: an idle phone need not wake up for this */
+static struct delayed_work fastpath_gc_work;
+
+static inline u32 fastpath_hash_key(int iif, __be32 saddr, __be32 daddr,
+				    __be16 sport, __be16 dport, u8 protonum)
+{
+	return jhash_3words((__force u32)saddr, (__force u32)daddr,
+			    ((__force u32)sport << 16 | (__force u32)dport)
+			    ^ protonum ^ iif, fastpath_rnd)
+		& (FASTPATH_HASH_SIZE - 1);
+}
+
+static inline u32 fastpath_flow_hash(const struct fastpath_flow *flow)
+{
+	return fastpath_hash_key(flow->iif, flow->saddr, flow->daddr,
+				 flow->sport, flow->dport, flow->protonum);
+}
+
+/* Called with rcu_read_lock() or fastpath_lock held */
+static struct fastpath_flow *
+fastpath_find(struct net *net, int iif, __be32 saddr, __be32 daddr,
+	      __be16 sport, __be16 dport, u8 protonum)
+{
+	struct fastpath_flow *flow;
+	struct hlist_node *n;
+	u32 h = fastpath_hash_key(iif, saddr, daddr, sport, dport, protonum);
+
+	hlist_for_each_entry_rcu(flow, n, &fastpath_hash[h], hnode) {
+		if (flow->saddr == saddr && flow->daddr == daddr &&
+		    flow->sport == sport && flow->dport == dport &&
+		    flow->protonum == protonum && flow->iif == iif &&
+		    net_eq(flow->net, net))
+			return flow;
+	}
+	return NULL;
+}
+
+static void fastpath_free_rcu(struct rcu_head *head)
+{
+	struct fastpath_flow *flow =
+		container_of(head, struct fastpath_flow, rcu);
+
+	dst_release(flow->dst);
+	nf_ct_put(flow->ct);
+	kmem_cache_free(fastpath_cachep, flow);
+}
+
+/* Called with fastpath_lock held */
+static void fastpath_unlink(struct fastpath_flow *flow)
+{
+	hlist_del_rcu(&flow->hnode);
+	fastpath_count--;
+	call_rcu(&flow->rcu, fastpath_free_rcu);
+}
+
+static inline bool fastpath_ct_usable(struct nf_conn *ct)
+{
+	if (nf_ct_is_dying(ct))
+		return false;
+	if (nf_ct_protonum(ct) == IPPROTO_TCP &&
+	    ct->proto.tcp.state != TCP_CONNTRACK_ESTABLISHED)
+		return false;
+	return true;
+}
+
+static void fastpath_flush(const struct net_device *dev, bool all);
+
+/*
+ * The flows were recorded under the iptables rules of their first
+ * packets.  Once the rules change, all of them have to go through the
+ * tables again.  Returns false if the flows were out of date.
+ */
+static bool fastpath_generation_check(void)
+{
+	int gen = atomic_read(&xt_table_generation);
+
+	if (likely(gen == ACCESS_ONCE(fastpath_generation)))
+		return true;
+
+	fastpath_flush(NULL, true);
+	spin_lock_bh(&fastpath_lock);
+	fastpath_generation = gen;
+	spin_unlock_bh(&fastpath_lock);
+	return false;
+}
+
+/*
+ * Apply the cached NAT mapping, the same way tcp_manip_pkt() and
+ * udp_manip_pkt() do.
+ */
+static void fastpath_mangle(struct sk_buff *skb, struct iphdr *iph,
+			    const struct fastpath_flow *flow)
+{
+	__sum16 *check = NULL;
+	__be16 *ports = (__be16 *)((u8 *)iph + sizeof(*iph));
+
+	if (flow->protonum == IPPROTO_TCP) {
+		check = &((struct tcphdr *)ports)->check;
+	} else {
+		struct udphdr *uh = (struct udphdr *)ports;
+
+		if (uh->check || skb->ip_summed == CHECKSUM_PARTIAL)
+			check = &uh->check;
+	}
+
+	if (iph->saddr != flow->nat_saddr) {
+		if (check)
+			inet_proto_csum_replace4(check, skb, iph->saddr,
+						 flow->nat_saddr, 1);
+		csum_replace4(&iph->check, iph->saddr, flow->nat_saddr);
+		iph->saddr = flow->nat_saddr;
+	}
+	if (iph->daddr != flow->nat_daddr) {
+		if (check)
+			inet_proto_csum_replace4(check, skb, iph->daddr,
+						 flow->nat_daddr, 1);
+		csum_replace4(&iph->check, iph->daddr, flow->nat_daddr);
+		iph->daddr = flow->nat_daddr;
+	}
+	if (ports[0] != flow->nat_sport) {
+		if (check)
+			inet_proto_csum_replace2(check, skb, ports[0],
+						 flow->nat_sport, 0);
+		ports[0] = flow->nat_sport;
+	}
+	if (ports[1] != flow->nat_dport) {
+		if (check)
+			inet_proto_csum_replace2(check, skb, ports[1],
+						 flow->nat_dport, 0);
+		ports[1] = flow->nat_dport;
+	}
+
+	if (flow->protonum == IPPROTO_UDP && check && !*check)
+		*check = CSUM_MANGLED_0;
+}
+
+static unsigned int fastpath_in(unsigned int hooknum,
+				struct sk_buff *skb,
+				const struct net_device *in,
+				const struct net_device *out,
+				int (*okfn)(struct sk_buff *))
+{
+	struct fastpath_flow *flow;
+	struct in_device *in_dev;
+	struct dst_entry *dst;
+	struct iphdr *iph;
+	const __be16 *ports;
+	unsigned int l4len;
+
+	if (!fastpath_enable || !fastpath_count)
+		return NF_ACCEPT;
+
+	/* forwarding may have been turned off since the flows were added */
+	in_dev = __in_dev_get_rcu(in);
+	if (!in_dev || !IN_DEV_FORWARD(in_dev))
+		return NF_ACCEPT;
+
+	if (!fastpath_generation_check())
+		return NF_ACCEPT;
+
+	iph = ip_hdr(skb);
+	if (iph->ihl != 5 || iph->frag_off & htons(IP_MF | IP_OFFSET) ||
+	    skb->pkt_type != PACKET_HOST || skb->nfct)
+		return NF_ACCEPT;
+
+	switch (iph->protocol) {
+	case IPPROTO_TCP:
+		l4len = sizeof(struct tcphdr);
+		break;
+	case IPPROTO_UDP:
+		l4len = sizeof(struct udphdr);
+		break;
+	default:
+		return NF_ACCEPT;
+	}
+	if (!pskb_may_pull(skb, sizeof(*iph) + l4len))
+		return NF_ACCEPT;
+	iph = ip_hdr(skb);
+	ports = (__be16 *)((u8 *)iph + sizeof(*iph));
+
+	if (iph->protocol == IPPROTO_TCP) {
+		const struct tcphdr *th = (const struct tcphdr *)ports;
+
+		if (th->syn || th->fin || th->rst)
+			return NF_ACCEPT;
+	}
+
+	flow = fastpath_find(dev_net(in), in->ifindex, iph->saddr,
+			     iph->daddr, ports[0], ports[1], iph->protocol);
+	if (!flow)
+		return NF_ACCEPT;
+
+	dst = flow->dst;
+	if (dst->obsolete || !fastpath_ct_usable(flow->ct) ||
+	    iph->ttl <= 1 ||
+	    (skb->len > dst_mtu(dst) && !skb_is_gso(skb)))
+		return NF_ACCEPT;
+
+	skb_forward_csum(skb);
+	if (skb_cow(skb, LL_RESERVED_SPACE(dst->dev) + dst->header_len))
+		return NF_ACCEPT;
+
+	/* conntrack's view of the connection keeps up with us */
+	nf_ct_refresh_acct(flow->ct, flow->ctinfo, skb, flow->timeout);
+	if (flow->last_used != jiffies)
+		flow->last_used = jiffies;
+
+	iph = ip_hdr(skb);
+	fastpath_mangle(skb, iph, flow);
+	ip_decrease_ttl(iph);
+	skb->priority = rt_tos2priority(iph->tos);
+
+	skb_dst_drop(skb);
+	skb_dst_set(skb, dst_clone(dst));
+	skb->dev = dst->dev;
+	skb->protocol = htons(ETH_P_IP);
+
+	__get_cpu_var(fastpath_stats).hits++;
+	IP_INC_STATS_BH(dev_net(dst->dev), IPSTATS_MIB_OUTFORWDATAGRAMS);
+
+	if (dst->hh)
+		neigh_hh_output(dst->hh, skb);
+	else if (dst->neighbour)
+		dst->neighbour->output(skb);
+	else
+		kfree_skb(skb);
+	return NF_STOLEN;
+}
+
+static void fastpath_add(struct sk_buff *skb, struct nf_conn *ct,
+			 enum ip_conntrack_info ctinfo, int iif)
+{
+	enum ip_conntrack_dir dir = CTINFO2DIR(ctinfo);
+	const struct nf_conntrack_tuple *tuple = &ct->tuplehash[dir].tuple;
+	const struct nf_conntrack_tuple *reply = &ct->tuplehash[!dir].tuple;
+	struct net *net = nf_ct_net(ct);
+	struct dst_entry *dst = skb_dst(skb);
+	struct fastpath_flow *flow;
+	long timeout;
+
+	/* the timeout conntrack just gave the connection */
+	timeout = ct->timeout.expires - jiffies;
+	if (timeout < HZ)
+		return;
+
+	if (!fastpath_generation_check())
+		return;
+
+	/* cheap unlocked check first, this runs for every packet */
+	rcu_read_lock();
+	flow = fastpath_find(net, iif, tuple->src.u3.ip,
+			     tuple->dst.u3.ip, tuple->src.u.all,
+			     tuple->dst.u.all, tuple->dst.protonum);
+	rcu_read_unlock();
+	if (flow)
+		return;
+
+	flow = kmem_cache_alloc(fastpath_cachep, GFP_ATOMIC);
+	if (!flow)
+		return;
+
+	flow->net = net;
+	flow->iif = iif;
+	flow->saddr = tuple->src.u3.ip;
+	flow->daddr = tuple->dst.u3.ip;
+	flow->sport = tuple->src.u.all;
+	flow->dport = tuple->dst.u.all;
+	flow->protonum = tuple->dst.protonum;
+	flow->nat_saddr = reply->dst.u3.ip;
+	flow->nat_daddr = reply->src.u3.ip;
+	flow->nat_sport = reply->dst.u.all;
+	flow->nat_dport = reply->src.u.all;
+	flow->ctinfo = ctinfo;
+	flow->timeout = timeout;
+	flow->last_used = jiffies;
+
+	spin_lock_bh(&fastpath_lock);
+	if (fastpath_count >= fastpath_max ||
+	    fastpath_find(net, flow->iif, flow->saddr, flow->daddr,
+			  flow->sport, flow->dport, flow->protonum)) {
+		spin_unlock_bh(&fastpath_lock);
+		kmem_cache_free(fastpath_cachep, flow);
+		return;
+	}
+
+	flow->dst = dst_clone(dst);
+	nf_conntrack_get(&ct->ct_general);
+	flow->ct = ct;
+
+	/*
+	 * conntrack no longer sees every segment, so its idea of the
+	 * TCP windows falls behind.  Don't let that turn the FIN or RST
+	 * it does see into an invalid packet.
+	 */
+	if (flow->protonum == IPPROTO_TCP) {
+		spin_lock(&ct->lock);
+		ct->proto.tcp.seen[0].flags |= IP_CT_TCP_FLAG_BE_LIBERAL;
+		ct->proto.tcp.seen[1].flags |= IP_CT_TCP_FLAG_BE_LIBERAL;
+		spin_unlock(&ct->lock);
+	}
+
+	hlist_add_head_rcu(&flow->hnode,
+			   &fastpath_hash[fastpath_flow_hash(flow)]);
+	if (!fastpath_count++)
+		schedule_delayed_work(&fastpath_gc_work, HZ);
+	spin_unlock_bh(&fastpath_lock);
+
+	__get_cpu_var(fastpath_stats).added++;
+}
+
+static unsigned int fastpath_out(unsigned int hooknum,
+				 struct sk_buff *skb,
+				 const struct net_device *in,
+				 const struct net_device *out,
+				 int (*okfn)(struct sk_buff *))
+{
+	const struct iphdr *iph = ip_hdr(skb);
+	enum ip_conntrack_info ctinfo;
+	struct dst_entry *dst;
+	struct rtable *rt;
+	struct nf_conn *ct;
+	struct nf_conn_help *help;
+
+	if (!fastpath_enable)
+		return NF_ACCEPT;
+
+	ct = nf_ct_get(skb, &ctinfo);
+	if (!ct || nf_ct_is_untracked(skb) ||
+	    (ctinfo != IP_CT_ESTABLISHED &&
+	     ctinfo != IP_CT_ESTABLISHED + IP_CT_IS_REPLY))
+		return NF_ACCEPT;
+
+	if (!test_bit(IPS_ASSURED_BIT, &ct->status) ||
+	    test_bit(IPS_SEQ_ADJUST_BIT, &ct->status) ||
+	    !nf_ct_is_confirmed(ct) || !fastpath_ct_usable(ct) ||
+	    nf_ct_zone(ct) != NF_CT_DEFAULT_ZONE)
+		return NF_ACCEPT;
+
+	help = nfct_help(ct);
+	if (help && help->helper)
+		return NF_ACCEPT;
+
+	if (iph->protocol != IPPROTO_TCP && iph->protocol != IPPROTO_UDP)
+		return NF_ACCEPT;
+	if (iph->ihl != 5 || skb->mark)
+		return NF_ACCEPT;
+
+	/* only forwarded packets have an input route */
+	rt = skb_rtable(skb);
+	if (!rt || !rt->fl.iif || rt->rt_type != RTN_UNICAST)
+		return NF_ACCEPT;
+	dst = &rt->u.dst;
+	if (dst->xfrm || dst->obsolete || !(dst->hh || dst->neighbour))
+		return NF_ACCEPT;
+
+	fastpath_add(skb, ct, ctinfo, rt->fl.iif);
+	return NF_ACCEPT;
+}
+
+/* Drop flows that are dead or unused; with @dev, all that use it. */
+static void fastpath_flush(const struct net_device *dev, bool all)
+{
+	unsigned long idle = fastpath_idle * HZ;
+	struct fastpath_flow *flow;
+	struct hlist_node *n, *tmp;
+	int i;
+
+	spin_lock_bh(&fastpath_lock);
+	for (i = 0; i < FASTPATH_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(flow, n, tmp, &fastpath_hash[i],
+					  hnode) {
+			if (all ||
+			    (dev && (flow->dst->dev == dev ||
+				     flow->iif == dev->ifindex)) ||
+			    (!dev && (flow->dst->obsolete ||
+				      !fastpath_ct_usable(flow->ct) ||
+				      time_after(jiffies,
+						 flow->last_used + idle))))
+				fastpath_unlink(flow);
+		}
+	}
+	spin_unlock_bh(&fastpath_lock);
+}
+
+static void fastpath_gc(struct work_struct *work)
+{
+	fastpath_flush(NULL, false);
+
+	spin_lock_bh(&fastpath_lock);
+	if (fastpath_count)
+		schedule_delayed_work(&fastpath_gc_work, HZ);
+	spin_unlock_bh(&fastpath_lock);
+}
+
+static int fastpath_netdev_event(struct notifier_block *this,
+				 unsigned long event, void *ptr)
+{
+	struct net_device *dev = ptr;
+
+	/* release our route references so the device can go away */
+	if (event == NETDEV_DOWN || event == NETDEV_UNREGISTER)
+		fastpath_flush(dev, false);
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block fastpath_netdev_notifier = {
+	.notifier_call	= fastpath_netdev_event,
+};
+
+static struct nf_hook_ops fastpath_ops[] __read_mostly = {
+	{
+		.hook		= fastpath_in,
+		.owner		= THIS_MODULE,
+		.pf		= PF_INET,
+		.hooknum	= NF_INET_PRE_ROUTING,
+		.priority	= NF_IP_PRI_FIRST,
+	},
+	{
+		/* after SNAT, so the NAT mapping is complete */
+		.hook		= fastpath_out,
+		.owner		= THIS_MODULE,
+		.pf		= PF_INET,
+		.hooknum	= NF_INET_POST_ROUTING,
+		.priority	= NF_IP_PRI_SELINUX_LAST + 1,
+	},
+};
+
+#ifdef CONFIG_PROC_FS
+static int fastpath_seq_show(struct seq_file *seq, void *v)
+{
+	unsigned long hits = 0, added = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		const struct fastpath_stat *st = &per_cpu(fastpath_stats, cpu);
+
+		hits += st->hits;
+		added += st->added;
+	}
+	seq_printf(seq, "flows %u\nadded %lu\nhits %lu\n",
+		   fastpath_count, added, hits);
+	return 0;
+}
+
+static int fastpath_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fastpath_seq_show, NULL);
+}
+
+static const struct file_operations fastpath_seq_fops = {
+	.owner		= THIS_MODULE,
+	.open		= fastpath_seq_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
+static int __init nf_conntrack_fastpath_init(void)
+{
+	int ret;
+
+	get_random_bytes(&fastpath_rnd, sizeof(fastpath_rnd));
+	INIT_DELAYED_WORK_DEFERRABLE(&fastpath_gc_work, fastpath_gc);
+
+	fastpath_cachep = KMEM_CACHE(fastpath_flow, 0);
+	if (!fastpath_cachep)
+		return -ENOMEM;
+
+	ret = register_netdevice_notifier(&fastpath_netdev_notifier);
+	if (ret < 0)
+		goto err_cache;
+
+	ret = nf_register_hooks(fastpath_ops, ARRAY_SIZE(fastpath_ops));
+	if (ret < 0)
+		goto err_notifier;
+
+	if (!proc_net_fops_create(&init_net, "nf_conntrack_fastpath",
+				  S_IRUGO, &fastpath_seq_fops))
+		pr_debug("nf_conntrack_fastpath: no proc entry\n");
+
+	return 0;
+
+err_notifier:
+	unregister_netdevice_notifier(&fastpath_netdev_notifier);
+err_cache:
+	kmem_cache_destroy(fastpath_cachep);
+	return ret;
+}
+
+static void __exit nf_conntrack_fastpath_fini(void)
+{
+	proc_net_remove(&init_net, "nf_conntrack_fastpath");
+	nf_unregister_hooks(fastpath_ops, ARRAY_SIZE(fastpath_ops));
+	unregister_netdevice_notifier(&fastpath_netdev_notifier);
+
+	cancel_delayed_work_sync(&fastpath_gc_work);
+	fastpath_flush(NULL, true);
+	rcu_barrier();
+	kmem_cache_destroy(fastpath_cachep);
+}
+
+module_init(nf_conntrack_fastpath_init);
+module_exit(nf_conntrack_fastpath_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("IPv4 forwarding fast path for established connections");
@@ -66,6 +66,14 @@ static const char *const xt_prefix[NFPROTO_NUMPROTO] = {
 /* Allow this many total (re)entries. */
 static const unsigned int xt_jumpstack_multiplier = 2;
 
+/*
+ * Bumped whenever a table is registered, replaced or unregistered, so
+ * that caches of verdicts, like the IPv4 conntrack fast path, can tell
+ * that the ruleset changed.
+ */
+atomic_t xt_table_generation = ATOMIC_INIT(0);
+EXPORT_SYMBOL_GPL(xt_table_generation);
+
 /* Registration hooks for targets. */
 int
 xt_register_target(struct xt_target *target)
@@ -815,6 +823,7 @@ xt_replace_table(struct xt_table *table,
 
 	table->private = newinfo;
 	newinfo->initial_entries = private->initial_entries;
+	atomic_inc(&xt_table_generation);
 
 	/*
 	 * Even though table entries have now been swapped, other CPU's
@@ -888,6 +897,7 @@ void *xt_unregister_table(struct xt_table *table)
 	mutex_lock(&xt[table->af].mutex);
 	private = table->private;
 	list_del(&table->list);
+	atomic_inc(&xt_table_generation);
 	mutex_unlock(&xt[table->af].mutex);
 	kfree(table);
 
@@ -0,0 +1,319 @@
+/*
+ * net/sched/sch_radio.c	Radio wakeup aware batching.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <net/netlink.h>
+#include <net/pkt_sched.h>
+
+/*
+ * A cellular radio that sent or received a packet stays in a high power
+ * state for several seconds afterwards (the "tail").  A packet sent
+ * while the radio is up is nearly free; one sent while it is idle costs
+ * a wakeup plus a whole tail.
+ *
+ * Packets are sorted into two bands by skb->priority.  Foreground
+ * packets go out immediately.  Background packets (by default
+ * TC_PRIO_BULK and TC_PRIO_FILLER, which is what SO_PRIORITY 1 and 2
+ * give) are held while the radio is idle and released together:
+ *
+ *  - as soon as the radio is up anyway, that is, within tail of the
+ *    last packet this device sent or received, or
+ *  - when the oldest of them has waited max_delay, in which case they
+ *    wake the radio once for all of them.
+ *
+ * Reception is seen through the device's rx_packets counter, so drivers
+ * that only keep private statistics look busy only when sending.
+ *
+ * The statistics count the wakeups the held traffic caused and those it
+ * would have caused had it been sent right away.
+ */
+
+struct radio_skb_cb {
+	psched_time_t		enqueued;
+};
+
+struct radio_sched_data {
+	u32			limit;
+	u64			tail;		/* in psched ticks */
+	u64			max_delay;
+	u8			prio2band[TC_PRIO_MAX + 1];
+
+	struct sk_buff_head	fg;
+	struct sk_buff_head	bg;
+	bool			holding;	/* bg waits for the radio */
+
+	psched_time_t		last_active;	/* radio last carried traffic */
+	psched_time_t		virt_active;	/* same, had bg not been held */
+	unsigned long		rx_packets;
+	struct qdisc_watchdog	watchdog;
+
+	u32			virt_wakeups;
+	struct tc_radio_xstats	stats;
+};
+
+static inline struct radio_skb_cb *radio_skb_cb(struct sk_buff *skb)
+{
+	BUILD_BUG_ON(sizeof(skb->cb) <
+		sizeof(struct qdisc_skb_cb) + sizeof(struct radio_skb_cb));
+	return (struct radio_skb_cb *)qdisc_skb_cb(skb)->data;
+}
+
+static inline u32 radio_ticks2us(u64 ticks)
+{
+	return div_u64(PSCHED_TICKS2NS(ticks), NSEC_PER_USEC);
+}
+
+static inline u64 radio_us2ticks(u32 us)
+{
+	return PSCHED_NS2TICKS((u64)us * NSEC_PER_USEC);
+}
+
+static bool radio_active(struct Qdisc *sch, psched_time_t now)
+{
+	struct radio_sched_data *q = qdisc_priv(sch);
+	unsigned long rx_packets = qdisc_dev(sch)->stats.rx_packets;
+
+	/* receiving keeps the radio up just as sending does */
+	if (rx_packets != q->rx_packets) {
+		q->rx_packets = rx_packets;
+		q->last_active = now;
+	}
+	return now - q->last_active < q->tail;
+}
+
+static int radio_enqueue(struct sk_buff *skb, struct Qdisc *sch)
+{
+	struct radio_sched_data *q = qdisc_priv(sch);
+	psched_time_t now = psched_get_time();
+
+	if (unlikely(sch->q.qlen >= q->limit))
+		return qdisc_drop(skb, sch);
+
+	radio_skb_cb(skb)->enqueued = now;
+
+	if (q->prio2band[skb->priority & TC_PRIO_MAX]) {
+		/* sent right away, would this packet wake the radio? */
+		if (!radio_active(sch, now) &&
+		    now - q->virt_active >= q->tail)
+			q->virt_wakeups++;
+		q->virt_active = now;
+
+		__skb_queue_tail(&q->bg, skb);
+	} else {
+		__skb_queue_tail(&q->fg, skb);
+	}
+
+	sch->q.qlen++;
+	sch->bstats.bytes += qdisc_pkt_len(skb);
+	sch->bstats.packets++;
+	return NET_XMIT_SUCCESS;
+}
+
+static struct sk_buff *radio_dequeue(struct Qdisc *sch)
+{
+	struct radio_sched_data *q = qdisc_priv(sch);
+	psched_time_t now = psched_get_time();
+	psched_time_t deadline;
+	struct sk_buff *skb;
+	u32 latency;
+
+	skb = __skb_dequeue(&q->fg);
+	if (skb)
+		goto out;
+
+	skb = skb_peek(&q->bg);
+	if (!skb)
+		return NULL;
+
+	deadline = radio_skb_cb(skb)->enqueued + q->max_delay;
+	if (radio_active(sch, now)) {
+		if (q->holding)
+			q->stats.bursts++;
+	} else if (now >= deadline) {
+		q->stats.wakeups++;
+	} else {
+		/*
+		 * Hold on, but look at the receive counter again before
+		 * the radio could have gone idle after a reception.
+		 */
+		q->holding = true;
+		sch->flags |= TCQ_F_THROTTLED;
+		qdisc_watchdog_schedule(&q->watchdog,
+					min_t(psched_time_t, deadline,
+					      now + q->tail / 2));
+		return NULL;
+	}
+
+	q->holding = false;
+	skb = __skb_dequeue(&q->bg);
+
+	latency = radio_ticks2us(now - radio_skb_cb(skb)->enqueued);
+	q->stats.packets++;
+	q->stats.total_latency += latency;
+	if (latency > q->stats.max_latency)
+		q->stats.max_latency = latency;
+out:
+	q->last_active = now;
+	sch->q.qlen--;
+	sch->flags &= ~TCQ_F_THROTTLED;
+	return skb;
+}
+
+static unsigned int radio_drop(struct Qdisc *sch)
+{
+	struct radio_sched_data *q = qdisc_priv(sch);
+	struct sk_buff *skb;
+	unsigned int len;
+
+	/* background traffic goes first */
+	skb = __skb_dequeue_tail(&q->bg);
+	if (!skb)
+		skb = __skb_dequeue_tail(&q->fg);
+	if (!skb)
+		return 0;
+
+	len = qdisc_pkt_len(skb);
+	kfree_skb(skb);
+	sch->q.qlen--;
+	sch->qstats.drops++;
+	return len;
+}
+
+static void radio_reset(struct Qdisc *sch)
+{
+	struct radio_sched_data *q = qdisc_priv(sch);
+
+	__skb_queue_purge(&q->fg);
+	__skb_queue_purge(&q->bg);
+	sch->q.qlen = 0;
+	q->holding = false;
+	qdisc_watchdog_cancel(&q->watchdog);
+}
+
+static void radio_destroy(struct Qdisc *sch)
+{
+	struct radio_sched_data *q = qdisc_priv(sch);
+
+	qdisc_watchdog_cancel(&q->watchdog);
+}
+
+static int radio_change(struct Qdisc *sch, struct nlattr *opt)
+{
+	struct radio_sched_data *q = qdisc_priv(sch);
+	struct tc_radio_qopt *ctl = nla_data(opt);
+	unsigned int qlen;
+	int i;
+
+	if (opt->nla_len < nla_attr_size(sizeof(*ctl)))
+		return -EINVAL;
+	if (!ctl->tail || ctl->max_delay < ctl->tail)
+		return -EINVAL;
+	for (i = 0; i <= TC_PRIO_MAX; i++)
+		if (ctl->priomap[i] > 1)
+			return -EINVAL;
+
+	sch_tree_lock(sch);
+	if (ctl->limit)
+		q->limit = ctl->limit;
+	q->tail = radio_us2ticks(ctl->tail);
+	q->max_delay = radio_us2ticks(ctl->max_delay);
+	memcpy(q->prio2band, ctl->priomap, TC_PRIO_MAX + 1);
+
+	qlen = sch->q.qlen;
+	while (sch->q.qlen > q->limit)
+		radio_drop(sch);
+	qdisc_tree_decrease_qlen(sch, qlen - sch->q.qlen);
+	sch_tree_unlock(sch);
+	return 0;
+}
+
+static int radio_init(struct Qdisc *sch, struct nlattr *opt)
+{
+	struct radio_sched_data *q = qdisc_priv(sch);
+
+	skb_queue_head_init(&q->fg);
+	skb_queue_head_init(&q->bg);
+	qdisc_watchdog_init(&q->watchdog, sch);
+
+	q->limit = qdisc_dev(sch)->tx_queue_len ? : 1;
+	q->tail = radio_us2ticks(5 * USEC_PER_SEC);
+	q->max_delay = radio_us2ticks(60 * USEC_PER_SEC);
+	q->prio2band[TC_PRIO_BULK] = 1;
+	q->prio2band[TC_PRIO_FILLER] = 1;
+	q->rx_packets = qdisc_dev(sch)->stats.rx_packets;
+
+	if (opt)
+		return radio_change(sch, opt);
+	return 0;
+}
+
+static int radio_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct radio_sched_data *q = qdisc_priv(sch);
+	unsigned char *b = skb_tail_pointer(skb);
+	struct tc_radio_qopt opt;
+
+	opt.limit = q->limit;
+	opt.tail = radio_ticks2us(q->tail);
+	opt.max_delay = radio_ticks2us(q->max_delay);
+	memcpy(opt.priomap, q->prio2band, TC_PRIO_MAX + 1);
+
+	NLA_PUT(skb, TCA_OPTIONS, sizeof(opt), &opt);
+
+	return skb->len;
+
+nla_put_failure:
+	nlmsg_trim(skb, b);
+	return -1;
+}
+
+static int radio_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
+{
+	struct radio_sched_data *q = qdisc_priv(sch);
+	struct tc_radio_xstats st = q->stats;
+
+	if (q->virt_wakeups > st.wakeups)
+		st.wakeups_saved = q->virt_wakeups - st.wakeups;
+
+	return gnet_stats_copy_app(d, &st, sizeof(st));
+}
+
+static struct Qdisc_ops radio_qdisc_ops __read_mostly = {
+	.id		=	"radio",
+	.priv_size	=	sizeof(struct radio_sched_data),
+	.enqueue	=	radio_enqueue,
+	.dequeue	=	radio_dequeue,
+	.peek		=	qdisc_peek_dequeued,
+	.drop		=	radio_drop,
+	.init		=	radio_init,
+	.reset		=	radio_reset,
+	.destroy	=	radio_destroy,
+	.change		=	radio_change,
+	.dump		=	radio_dump,
+	.dump_stats	=	radio_dump_stats,
+	.owner		=	THIS_MODULE,
+};
+
+static int __init radio_module_init(void)
+{
+	return register_qdisc(&radio_qdisc_ops);
+}
+
+static void __exit radio_module_exit(void)
+{
+	unregister_qdisc(&radio_qdisc_ops);
+}
+module_init(radio_module_init)
+module_exit(radio_module_exit)
+MODULE_LICENSE("GPL");
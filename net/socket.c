@@ -95,6 +95,7 @@
 #include <net/compat.h>
 #include <net/wext.h>
 #include <net/cls_cgroup.h>
+#include <net/socktag.h>
 
 #include <net/sock.h>
 #include <linux/netfilter.h>
@@ -571,6 +572,7 @@ static inline int __sock_sendmsg(struct kiocb *iocb, struct socket *sock,
 		return err;
 
 	err = sock->ops->sendmsg(iocb, sock, msg, size);
+	socktag_charge(sock->sk, SOCKTAG_TX, err);
 	return err;
 }
 
@@ -698,6 +700,7 @@ static inline int __sock_recvmsg_nosec(struct kiocb *iocb, struct socket *sock,
 	si->flags = flags;
 
 	err = sock->ops->recvmsg(iocb, sock, msg, size, flags);
+	socktag_charge(sock->sk, SOCKTAG_RX, err);
 	return err;
 }
 
@@ -781,13 +784,16 @@ static ssize_t sock_splice_read(struct file *file, loff_t *ppos,
 				unsigned int flags)
 {
 	struct socket *sock = file->private_data;
+	ssize_t ret;
 
 	if (unlikely(!sock->ops->splice_read))
 		return -EINVAL;
 
 	sock_update_classid(sock->sk);
 
-	return sock->ops->splice_read(sock, ppos, pipe, len, flags);
+	ret = sock->ops->splice_read(sock, ppos, pipe, len, flags);
+	socktag_charge(sock->sk, SOCKTAG_RX, ret);
+	return ret;
 }
 
 static struct sock_iocb *alloc_sock_iocb(struct kiocb *iocb,
@@ -3079,12 +3085,17 @@ int kernel_setsockopt(struct socket *sock, int level, int optname,
 int kernel_sendpage(struct socket *sock, struct page *page, int offset,
 		    size_t size, int flags)
 {
+	int ret;
+
 	sock_update_classid(sock->sk);
 
-	if (sock->ops->sendpage)
-		return sock->ops->sendpage(sock, page, offset, size, flags);
+	/* sock_no_sendpage() is charged in __sock_sendmsg() */
+	if (!sock->ops->sendpage)
+		return sock_no_sendpage(sock, page, offset, size, flags);
 
-	return sock_no_sendpage(sock, page, offset, size, flags);
+	ret = sock->ops->sendpage(sock, page, offset, size, flags);
+	socktag_charge(sock->sk, SOCKTAG_TX, ret);
+	return ret;
 }
 
 int kernel_sock_ioctl(struct socket *sock, int cmd, unsigned long arg)
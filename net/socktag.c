@@ -0,0 +1,356 @@
+/* net/socktag.c
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Per-UID and per-tag accounting of IPv4/IPv6 socket traffic.
+ *
+ * Every socket charges the bytes it sends and receives to a stats entry
+ * keyed by (tag, uid).  Untagged sockets use tag 0 and the uid that
+ * created them; a process can tag its sockets, for instance with the
+ * id of the library doing the transfer, through /proc/net/socktag/ctrl:
+ *
+ *	t <fd> <tag> [<uid>]	tag socket fd of the writer, charging it
+ *				to uid (CAP_NET_ADMIN for another uid)
+ *	u <fd>			untag it again
+ *	d <tag> <uid>		delete the entry, or all entries of uid
+ *				if tag is 0
+ *
+ * /proc/net/socktag/stats dumps all entries at once.
+ *
+ * The socket keeps a reference to its entry, so charging needs neither
+ * a lookup nor a lock: it bumps counters in this CPU's slot of the
+ * entry, which are only summed up when the stats are read.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/rculist.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/file.h>
+#include <linux/capability.h>
+#include <linux/cred.h>
+#include <linux/net.h>
+#include <net/net_namespace.h>
+#include <net/socktag.h>
+
+int socktag_enabled __read_mostly = 1;
+module_param_named(enable, socktag_enabled, bool, 0644);
+MODULE_PARM_DESC(enable, "charge socket traffic to its uid and tag");
+
+/* this CPU's share of an entry; seq lets readers see whole 64-bit values */
+struct socktag_counters {
+	seqcount_t		seq;
+	u64			bytes[2];
+	u64			calls[2];
+} ____cacheline_aligned_in_smp;
+
+struct socktag_stat {
+	struct hlist_node	hnode;
+	u32			tag;
+	uid_t			uid;
+	/* one for the hash table, one for each socket using it */
+	atomic_t		refcnt;
+	struct rcu_head		rcu;
+	struct socktag_counters	counters[0];
+};
+
+#define SOCKTAG_HASH_BITS	8
+
+static struct hlist_head socktag_hash[1 << SOCKTAG_HASH_BITS];
+static DEFINE_SPINLOCK(socktag_lock);	/* guards socktag_hash writers */
+
+static inline struct hlist_head *socktag_bucket(u32 tag, uid_t uid)
+{
+	return &socktag_hash[hash_32(tag ^ hash_32(uid, 32),
+				     SOCKTAG_HASH_BITS)];
+}
+
+static void socktag_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct socktag_stat, rcu));
+}
+
+static void socktag_put(struct socktag_stat *st)
+{
+	if (st && atomic_dec_and_test(&st->refcnt))
+		call_rcu(&st->rcu, socktag_free_rcu);
+}
+
+/* Find or create the entry for (tag, uid), with a reference for the caller */
+static struct socktag_stat *socktag_get(u32 tag, uid_t uid, gfp_t gfp)
+{
+	struct hlist_head *head = socktag_bucket(tag, uid);
+	struct socktag_stat *st, *new;
+	struct hlist_node *n;
+	int cpu;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(st, n, head, hnode) {
+		if (st->tag == tag && st->uid == uid &&
+		    atomic_inc_not_zero(&st->refcnt)) {
+			rcu_read_unlock();
+			return st;
+		}
+	}
+	rcu_read_unlock();
+
+	new = kzalloc(sizeof(*new) +
+		      nr_cpu_ids * sizeof(struct socktag_counters), gfp);
+	if (!new)
+		return NULL;
+	new->tag = tag;
+	new->uid = uid;
+	atomic_set(&new->refcnt, 2);
+	for_each_possible_cpu(cpu)
+		seqcount_init(&new->counters[cpu].seq);
+
+	spin_lock_bh(&socktag_lock);
+	hlist_for_each_entry(st, n, head, hnode) {
+		if (st->tag == tag && st->uid == uid) {
+			/* hashed entries always hold the table's reference */
+			atomic_inc(&st->refcnt);
+			spin_unlock_bh(&socktag_lock);
+			kfree(new);
+			return st;
+		}
+	}
+	hlist_add_head_rcu(&new->hnode, head);
+	spin_unlock_bh(&socktag_lock);
+
+	return new;
+}
+
+/* Called under rcu_read_lock() */
+static struct socktag_stat *socktag_sk_default(struct sock *sk)
+{
+	struct socktag_stat *st, *old;
+
+	st = socktag_get(0, sock_i_uid(sk), GFP_ATOMIC);
+	if (!st)
+		return NULL;
+
+	old = cmpxchg(&sk->sk_tag_stat, NULL, st);
+	if (old) {
+		/* somebody else got there first */
+		socktag_put(st);
+		st = old;
+	}
+	return st;
+}
+
+void __socktag_charge(struct sock *sk, int dir, int bytes)
+{
+	struct socktag_counters *c;
+	struct socktag_stat *st;
+
+	rcu_read_lock();
+	st = rcu_dereference(sk->sk_tag_stat);
+	if (unlikely(!st)) {
+		st = socktag_sk_default(sk);
+		if (!st)
+			goto out;
+	}
+
+	local_bh_disable();
+	c = &st->counters[smp_processor_id()];
+	write_seqcount_begin(&c->seq);
+	c->bytes[dir] += bytes;
+	c->calls[dir]++;
+	write_seqcount_end(&c->seq);
+	local_bh_enable();
+out:
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL(__socktag_charge);
+
+void socktag_sk_free(struct sock *sk)
+{
+	socktag_put(sk->sk_tag_stat);
+	sk->sk_tag_stat = NULL;
+}
+
+static int socktag_tag(int fd, u32 tag, uid_t uid)
+{
+	struct socktag_stat *st = NULL;
+	struct socket *sock;
+	int err;
+
+	if (uid != current_fsuid() && !capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	sock = sockfd_lookup(fd, &err);
+	if (!sock)
+		return err;
+
+	if (tag) {
+		st = socktag_get(tag, uid, GFP_KERNEL);
+		if (!st) {
+			sockfd_put(sock);
+			return -ENOMEM;
+		}
+	}
+	/* untagged sockets pick their default entry again on next use */
+	socktag_put(xchg(&sock->sk->sk_tag_stat, st));
+
+	sockfd_put(sock);
+	return 0;
+}
+
+static int socktag_delete(u32 tag, uid_t uid)
+{
+	struct socktag_stat *st;
+	struct hlist_node *n, *tmp;
+	int i;
+
+	if (uid != current_fsuid() && !capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	spin_lock_bh(&socktag_lock);
+	for (i = 0; i < ARRAY_SIZE(socktag_hash); i++) {
+		hlist_for_each_entry_safe(st, n, tmp, &socktag_hash[i],
+					  hnode) {
+			if (st->uid != uid || (tag && st->tag != tag))
+				continue;
+			hlist_del_rcu(&st->hnode);
+			socktag_put(st);
+		}
+	}
+	spin_unlock_bh(&socktag_lock);
+	return 0;
+}
+
+static ssize_t socktag_ctrl_write(struct file *file, const char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	char cmd[64];
+	unsigned int tag, uid;
+	int fd, n, err;
+
+	if (count >= sizeof(cmd))
+		return -EINVAL;
+	if (copy_from_user(cmd, buf, count))
+		return -EFAULT;
+	cmd[count] = '\0';
+
+	switch (cmd[0]) {
+	case 't':
+		n = sscanf(cmd + 1, "%d %u %u", &fd, &tag, &uid);
+		if (n < 2 || !tag)
+			return -EINVAL;
+		err = socktag_tag(fd, tag, n == 3 ? uid : current_fsuid());
+		break;
+	case 'u':
+		if (sscanf(cmd + 1, "%d", &fd) != 1)
+			return -EINVAL;
+		err = socktag_tag(fd, 0, current_fsuid());
+		break;
+	case 'd':
+		if (sscanf(cmd + 1, "%u %u", &tag, &uid) != 2)
+			return -EINVAL;
+		err = socktag_delete(tag, uid);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return err ? err : count;
+}
+
+static const struct file_operations socktag_ctrl_fops = {
+	.owner		= THIS_MODULE,
+	.write		= socktag_ctrl_write,
+};
+
+static void socktag_sum(const struct socktag_stat *st, u64 *bytes, u64 *calls)
+{
+	int cpu;
+
+	bytes[0] = bytes[1] = calls[0] = calls[1] = 0;
+	for_each_possible_cpu(cpu) {
+		const struct socktag_counters *c = &st->counters[cpu];
+		u64 b0, b1, c0, c1;
+		unsigned int seq;
+
+		do {
+			seq = read_seqcount_begin(&c->seq);
+			b0 = c->bytes[0];
+			b1 = c->bytes[1];
+			c0 = c->calls[0];
+			c1 = c->calls[1];
+		} while (read_seqcount_retry(&c->seq, seq));
+
+		bytes[0] += b0;
+		bytes[1] += b1;
+		calls[0] += c0;
+		calls[1] += c1;
+	}
+}
+
+static int socktag_stats_show(struct seq_file *m, void *v)
+{
+	struct socktag_stat *st;
+	struct hlist_node *n;
+	u64 bytes[2], calls[2];
+	int i;
+
+	seq_puts(m, "tag uid rx_bytes rx_calls tx_bytes tx_calls\n");
+
+	rcu_read_lock();
+	for (i = 0; i < ARRAY_SIZE(socktag_hash); i++) {
+		hlist_for_each_entry_rcu(st, n, &socktag_hash[i], hnode) {
+			socktag_sum(st, bytes, calls);
+			seq_printf(m, "0x%x %u %llu %llu %llu %llu\n",
+				   st->tag, st->uid,
+				   bytes[SOCKTAG_RX], calls[SOCKTAG_RX],
+				   bytes[SOCKTAG_TX], calls[SOCKTAG_TX]);
+		}
+	}
+	rcu_read_unlock();
+	return 0;
+}
+
+static int socktag_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, socktag_stats_show, NULL);
+}
+
+static const struct file_operations socktag_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= socktag_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init socktag_init(void)
+{
+	struct proc_dir_entry *dir;
+
+	dir = proc_mkdir("socktag", init_net.proc_net);
+	if (!dir) {
+		pr_err("socktag: failed to create proc entry\n");
+		return -ENOMEM;
+	}
+	proc_create("ctrl", S_IWUGO, dir, &socktag_ctrl_fops);
+	proc_create("stats", S_IRUGO, dir, &socktag_stats_fops);
+	return 0;
+}
+
+subsys_initcall(socktag_init);
@@ -114,6 +114,7 @@
 #include <linux/mount.h>
 #include <net/checksum.h>
 #include <linux/security.h>
+#include <linux/splice.h>
 
 static struct hlist_head unix_socket_table[UNIX_HASH_SIZE + 1];
 static DEFINE_SPINLOCK(unix_table_lock);
@@ -172,6 +173,12 @@ static inline int unix_recvq_full(struct sock const *sk)
 	return skb_queue_len(&sk->sk_receive_queue) > sk->sk_max_ack_backlog;
 }
 
+/* Bytes of a stream skb not read yet */
+static inline unsigned int unix_skb_len(const struct sk_buff *skb)
+{
+	return skb->len - UNIXCB(skb).consumed;
+}
+
 static struct sock *unix_peer_get(struct sock *s)
 {
 	struct sock *peer;
@@ -352,6 +359,12 @@ static void unix_sock_destructor(struct sock *sk)
 
 	skb_queue_purge(&sk->sk_receive_queue);
 
+	/* left over from copying linear data in unix_stream_splice_read() */
+	if (sk->sk_sndmsg_page) {
+		__free_page(sk->sk_sndmsg_page);
+		sk->sk_sndmsg_page = NULL;
+	}
+
 	WARN_ON(atomic_read(&sk->sk_wmem_alloc));
 	WARN_ON(!sk_unhashed(sk));
 	WARN_ON(sk->sk_socket);
@@ -504,6 +517,11 @@ static int unix_dgram_connect(struct socket *, struct sockaddr *,
 			      int, int);
 static int unix_seqpacket_sendmsg(struct kiocb *, struct socket *,
 				  struct msghdr *, size_t);
+static ssize_t unix_stream_sendpage(struct socket *, struct page *, int,
+				    size_t, int);
+static ssize_t unix_stream_splice_read(struct socket *, loff_t *,
+				       struct pipe_inode_info *, size_t,
+				       unsigned int);
 
 static const struct proto_ops unix_stream_ops = {
 	.family =	PF_UNIX,
@@ -523,7 +541,8 @@ static const struct proto_ops unix_stream_ops = {
 	.sendmsg =	unix_stream_sendmsg,
 	.recvmsg =	unix_stream_recvmsg,
 	.mmap =		sock_no_mmap,
-	.sendpage =	sock_no_sendpage,
+	.sendpage =	unix_stream_sendpage,
+	.splice_read =	unix_stream_splice_read,
 };
 
 static const struct proto_ops unix_dgram_ops = {
@@ -1622,6 +1641,66 @@ out_err:
 	return sent ? : err;
 }
 
+/*
+ *	Queue a reference to the page instead of a copy of its data, so
+ *	splice() and sendfile() into a unix stream socket copy nothing.
+ *	As with TCP, the reader sees whatever the page holds when it
+ *	reads; vmsplice() with SPLICE_F_GIFT hands pages over for good.
+ */
+static ssize_t unix_stream_sendpage(struct socket *sock, struct page *page,
+				    int offset, size_t size, int flags)
+{
+	struct sock *sk = sock->sk;
+	struct sock *other;
+	struct sk_buff *skb;
+	int err;
+
+	if (flags&MSG_OOB)
+		return -EOPNOTSUPP;
+
+	other = unix_peer(sk);
+	if (!other)
+		return -ENOTCONN;
+
+	if (sk->sk_shutdown & SEND_SHUTDOWN)
+		goto pipe_err;
+
+	skb = sock_alloc_send_skb(sk, 0, flags&MSG_DONTWAIT, &err);
+	if (skb == NULL)
+		return err;
+
+	/* the same credentials scm_send() would give a sendmsg() */
+	UNIXCREDS(skb)->pid = task_tgid_vnr(current);
+	UNIXCREDS(skb)->uid = current_uid();
+	UNIXCREDS(skb)->gid = current_gid();
+
+	get_page(page);
+	skb_fill_page_desc(skb, 0, page, offset, size);
+	skb->len = size;
+	skb->data_len = size;
+	skb->truesize += size;
+	atomic_add(size, &sk->sk_wmem_alloc);
+
+	unix_state_lock(other);
+
+	if (sock_flag(other, SOCK_DEAD) ||
+	    (other->sk_shutdown & RCV_SHUTDOWN))
+		goto pipe_err_free;
+
+	skb_queue_tail(&other->sk_receive_queue, skb);
+	unix_state_unlock(other);
+	other->sk_data_ready(other, size);
+	return size;
+
+pipe_err_free:
+	unix_state_unlock(other);
+	kfree_skb(skb);
+pipe_err:
+	if (!(flags&MSG_NOSIGNAL))
+		send_sig(SIGPIPE, current, 0);
+	return -EPIPE;
+}
+
 static int unix_seqpacket_sendmsg(struct kiocb *kiocb, struct socket *sock,
 				  struct msghdr *msg, size_t len)
 {
@@ -1867,8 +1946,9 @@ static int unix_stream_recvmsg(struct kiocb *iocb, struct socket *sock,
 			sunaddr = NULL;
 		}
 
-		chunk = min_t(unsigned int, skb->len, size);
-		if (memcpy_toiovec(msg->msg_iov, skb->data, chunk)) {
+		chunk = min_t(unsigned int, unix_skb_len(skb), size);
+		if (skb_copy_datagram_iovec(skb, UNIXCB(skb).consumed,
+					    msg->msg_iov, chunk)) {
 			skb_queue_head(&sk->sk_receive_queue, skb);
 			if (copied == 0)
 				copied = -EFAULT;
@@ -1879,13 +1959,13 @@ static int unix_stream_recvmsg(struct kiocb *iocb, struct socket *sock,
 
 		/* Mark read part of skb as used */
 		if (!(flags & MSG_PEEK)) {
-			skb_pull(skb, chunk);
+			UNIXCB(skb).consumed += chunk;
 
 			if (UNIXCB(skb).fp)
 				unix_detach_fds(siocb->scm, skb);
 
 			/* put the skb back if we didn't use it up.. */
-			if (skb->len) {
+			if (unix_skb_len(skb)) {
 				skb_queue_head(&sk->sk_receive_queue, skb);
 				break;
 			}
@@ -1912,6 +1992,110 @@ out:
 	return copied ? : err;
 }
 
+static ssize_t unix_splice_to_pipe(struct sock *sk,
+				   struct pipe_inode_info *pipe,
+				   struct splice_pipe_desc *spd)
+{
+	/* u->readlock stays held, nobody takes it under the pipe lock */
+	return splice_to_pipe(pipe, spd);
+}
+
+/*
+ *	Move queued data into a pipe.  Paged skbs, as queued by
+ *	unix_stream_sendpage(), get their pages linked into the pipe
+ *	without a copy.  Passed descriptors are dropped as read() does.
+ */
+static ssize_t unix_stream_splice_read(struct socket *sock, loff_t *ppos,
+				       struct pipe_inode_info *pipe,
+				       size_t len, unsigned int flags)
+{
+	struct sock *sk = sock->sk;
+	struct unix_sock *u = unix_sk(sk);
+	struct scm_cookie scm;
+	ssize_t spliced = 0;
+	int err = 0;
+	long timeo;
+
+	if (unlikely(*ppos))
+		return -ESPIPE;
+
+	if (sk->sk_state != TCP_ESTABLISHED)
+		return -EINVAL;
+
+	timeo = sock_rcvtimeo(sk, (sock->file->f_flags & O_NONBLOCK) ||
+			      (flags & SPLICE_F_NONBLOCK));
+	memset(&scm, 0, sizeof(scm));
+
+	mutex_lock(&u->readlock);
+
+	while (len) {
+		struct sk_buff *skb;
+		int chunk, ret;
+
+		unix_state_lock(sk);
+		skb = skb_peek(&sk->sk_receive_queue);
+		if (skb == NULL) {
+			if (spliced)
+				goto unlock;
+
+			err = sock_error(sk);
+			if (err)
+				goto unlock;
+			if (sk->sk_shutdown & RCV_SHUTDOWN)
+				goto unlock;
+
+			unix_state_unlock(sk);
+			err = -EAGAIN;
+			if (!timeo)
+				break;
+			mutex_unlock(&u->readlock);
+
+			timeo = unix_stream_data_wait(sk, timeo);
+
+			if (signal_pending(current)) {
+				err = sock_intr_errno(timeo);
+				goto out;
+			}
+			mutex_lock(&u->readlock);
+			continue;
+ unlock:
+			unix_state_unlock(sk);
+			break;
+		}
+		unix_state_unlock(sk);
+
+		/* readers hold u->readlock, so skb stays at the head */
+		chunk = min_t(unsigned int, unix_skb_len(skb), len);
+		ret = skb_splice_bits(skb, sk, UNIXCB(skb).consumed, pipe,
+				      chunk, flags, unix_splice_to_pipe);
+		if (ret <= 0) {
+			err = ret;
+			break;
+		}
+		spliced += ret;
+		len -= ret;
+
+		UNIXCB(skb).consumed += ret;
+		if (UNIXCB(skb).fp)
+			unix_detach_fds(&scm, skb);
+
+		/* the pipe is full, or len is used up */
+		if (unix_skb_len(skb))
+			break;
+
+		skb_unlink(skb, &sk->sk_receive_queue);
+		kfree_skb(skb);
+
+		if (scm.fp)
+			break;
+	}
+
+	mutex_unlock(&u->readlock);
+	scm_destroy(&scm);
+out:
+	return spliced ? : err;
+}
+
 static int unix_shutdown(struct socket *sock, int mode)
 {
 	struct sock *sk = sock->sk;
@@ -1976,7 +2160,7 @@ static int unix_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg)
 			if (sk->sk_type == SOCK_STREAM ||
 			    sk->sk_type == SOCK_SEQPACKET) {
 				skb_queue_walk(&sk->sk_receive_queue, skb)
-					amount += skb->len;
+					amount += unix_skb_len(skb);
 			} else {
 				skb = skb_peek(&sk->sk_receive_queue);
 				if (skb)